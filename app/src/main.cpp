@@ -1,4 +1,5 @@
 #include <iostream>
+#include <limits>
 #include <map>
 #include <filesystem>
 #include "tftpserver.h"
@@ -23,7 +24,7 @@ int main(int argc, char* argv[])
 
 void print_usage_msg()
 {
-    std::string msg = "Usage: TTFTP <--type=server/client> <--root=rootfolder> <--port=portnumber> <Client: --request=read/write> <Client: --file=filename> <Client: remote IP (ipv4 or ipv6)>";
+    std::string msg = "Usage: TTFTP <--type=server/client> <--root=rootfolder> <--port=portnumber> <Client: --request=read/write> <Client: --file=filename> <Client: --blksize=size> <Client: --timeout=seconds> <Client: --utimeout=microseconds> <Client: --windowsize=blocks> <Client: --rollover=0/1> <Server: --cachesize=megabytes> <Server: --threads=count> <Server: --fileio=threads/uring> <Server: --directio=megabytes> <Client: remote IP (ipv4 or ipv6)>";
     std::cout << msg << "\n";
     exit(1);
 }
@@ -47,6 +48,13 @@ void run(int argc, char* argv[])
     namedArgValues["--blksize="] = "";
     namedArgValues["--port="] = "";
     namedArgValues["--timeout="] = "";
+    namedArgValues["--utimeout="] = "";
+    namedArgValues["--windowsize="] = "";
+    namedArgValues["--rollover="] = "";
+    namedArgValues["--cachesize="] = "";
+    namedArgValues["--threads="] = "";
+    namedArgValues["--fileio="] = "";
+    namedArgValues["--directio="] = "";
     boost::asio::ip::address serverAddress;
 
     //check all named args, IP must be last and will be checked separately
@@ -117,6 +125,36 @@ void run(int argc, char* argv[])
                 }
                 client_trans_values.mTimeout = timeout;
             }
+            if(namedArgValues.at("--utimeout=") != "")
+            {
+                long utimeout = 0;
+                if(!parseOptionNumber(namedArgValues.at("--utimeout="), utimeout) || utimeout < 10000 || utimeout > 255000000)
+                {
+                    std::cerr << "Invalid utimeout option supplied! Utimeout must be >=10000 and <=255000000.\n";
+                    print_usage_msg();
+                }
+                client_trans_values.mUTimeout = utimeout;
+            }
+            if(namedArgValues.at("--windowsize=") != "")
+            {
+                int windowsize = 0;
+                if(!parseOptionNumber(namedArgValues.at("--windowsize="), windowsize) || windowsize < 1 || windowsize > MAX_WINDOWSIZE)
+                {
+                    std::cerr << "Invalid windowsize option supplied! Windowsize must be >=1 and <=" << MAX_WINDOWSIZE << ".\n";
+                    print_usage_msg();
+                }
+                client_trans_values.mWindowsize = windowsize;
+            }
+            if(namedArgValues.at("--rollover=") != "")
+            {
+                const std::string rollover = namedArgValues.at("--rollover=");
+                if(rollover != "0" && rollover != "1")
+                {
+                    std::cerr << "Invalid rollover option supplied! Rollover must be 0 or 1.\n";
+                    print_usage_msg();
+                }
+                client_trans_values.mRollover = rollover == "1" ? 1 : 0;
+            }
 
             uint16_t server_port = SERVER_LISTEN_PORT;
             if(namedArgValues.at("--port=") != "")
@@ -149,6 +187,10 @@ void run(int argc, char* argv[])
             if(error == TftpUserFacingErrorCode::ERR_NOERR)
             {
                 std::cout << "Write/Read finished! Exiting\n";
+                if(client.get_checksum().has_value())
+                {
+                    std::cout << "crc32c of the file: " << std::hex << client.get_checksum().value() << std::dec << "\n";
+                }
                 //TODO: remove file if receiving and error condition
             }
             else
@@ -169,7 +211,48 @@ void run(int argc, char* argv[])
             //TODO: handle case where port= value is not numeric
             port = std::atoi(namedArgValues.at("--port=").c_str());
         }
-        TftpServer server(namedArgValues.at("--root="), ctx, port);
+        std::size_t cachebytes = DEFAULT_BLOCK_CACHE_BYTES;
+        if(namedArgValues.at("--cachesize=") != "")
+        {
+            std::size_t cachemegabytes = 0;
+            if(!parseOptionNumber(namedArgValues.at("--cachesize="), cachemegabytes) || cachemegabytes > std::numeric_limits<std::size_t>::max() / (1024 * 1024))
+            {
+                std::cerr << "Invalid cachesize option supplied! Cachesize must be a number of megabytes, 0 disables the cache.\n";
+                print_usage_msg();
+            }
+            cachebytes = cachemegabytes * 1024 * 1024;
+        }
+        unsigned int threads = DEFAULT_SERVER_THREADS;
+        if(namedArgValues.at("--threads=") != "")
+        {
+            if(!parseOptionNumber(namedArgValues.at("--threads="), threads) || threads == 0)
+            {
+                std::cerr << "Invalid threads option supplied! Threads must be a number of at least 1.\n";
+                print_usage_msg();
+            }
+        }
+        TftpFileIoBackend fileio = TftpFileIoBackend::THREADS;
+        if(namedArgValues.at("--fileio=") == "uring")
+        {
+            fileio = TftpFileIoBackend::IO_URING;
+        }
+        else if(namedArgValues.at("--fileio=") != "" && namedArgValues.at("--fileio=") != "threads")
+        {
+            std::cerr << "Invalid fileio option supplied! Possible values are threads and uring.\n";
+            print_usage_msg();
+        }
+        uint64_t directiothreshold = DEFAULT_DIRECT_IO_THRESHOLD_BYTES;
+        if(namedArgValues.at("--directio=") != "")
+        {
+            uint64_t directiomegabytes = 0;
+            if(!parseOptionNumber(namedArgValues.at("--directio="), directiomegabytes) || directiomegabytes > std::numeric_limits<uint64_t>::max() / (1024 * 1024))
+            {
+                std::cerr << "Invalid directio option supplied! Directio must be a number of megabytes, 0 disables direct I/O.\n";
+                print_usage_msg();
+            }
+            directiothreshold = directiomegabytes * 1024 * 1024;
+        }
+        TftpServer server(namedArgValues.at("--root="), ctx, port, cachebytes, threads, fileio, directiothreshold);
 
         //This call blocks until an error happens or a SIGTERM etc. arrives
         server.run();
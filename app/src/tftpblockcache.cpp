@@ -0,0 +1,369 @@
+#include "tftpblockcache.h"
+#include "tftphelpdefs.h"
+#include <algorithm>
+#include <functional>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+bool TftpFileIdentity::operator==(const TftpFileIdentity &rhs) const
+{
+    return device == rhs.device && inode == rhs.inode && mtime_sec == rhs.mtime_sec && mtime_nsec == rhs.mtime_nsec && size == rhs.size;
+}
+
+bool TftpBlockCache::Key::operator==(const Key &rhs) const
+{
+    return file == rhs.file && blocksize == rhs.blocksize && chunkindex == rhs.chunkindex;
+}
+
+std::size_t TftpBlockCache::KeyHash::operator()(const Key &IN_key) const
+{
+    std::size_t hash = std::hash<uint64_t>{}(IN_key.file.inode);
+    const auto combine = [&hash](uint64_t value)
+    {
+        hash ^= std::hash<uint64_t>{}(value) + 0x9e3779b97f4a7c15ULL + (hash << 6) + (hash >> 2);
+    };
+    combine(IN_key.file.device);
+    combine(IN_key.file.mtime_sec);
+    combine(IN_key.file.mtime_nsec);
+    combine(IN_key.blocksize);
+    combine(IN_key.chunkindex);
+    return hash;
+}
+
+/*!
+ * \brief TftpBlockCache::TftpBlockCache
+ * \param IN_budgetbytes maximum amount of file data held by the cache. Chunks that do not fit are handed out without being cached.
+ */
+TftpBlockCache::TftpBlockCache(std::size_t IN_budgetbytes)
+    :mBudgetBytes(IN_budgetbytes)
+{
+}
+
+TftpBlockCache::Chunk TftpBlockCache::getChunk(const TftpFileIdentity &IN_file, int IN_fd, std::size_t IN_blocksize, uint64_t IN_chunkindex)
+{
+    const Key key{IN_file, IN_blocksize, IN_chunkindex};
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        const auto found = mIndex.find(key);
+        if(found != mIndex.end())
+        {
+            Slot &slot = mSlots[found->second];
+            slot.referenced = true;
+            return slot.chunk;
+        }
+    }
+
+    //The read happens without holding the lock, so other transfers are not stalled by the disk. If two transfers miss the same chunk at once, the first insert wins
+    Chunk chunk = readChunk(IN_fd, key);
+    if(!chunk)
+    {
+        return {};
+    }
+    return addChunk(IN_file, IN_blocksize, IN_chunkindex, chunk);
+}
+
+TftpBlockCache::Chunk TftpBlockCache::findChunk(const TftpFileIdentity &IN_file, std::size_t IN_blocksize, uint64_t IN_chunkindex)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    const auto found = mIndex.find(Key{IN_file, IN_blocksize, IN_chunkindex});
+    if(found == mIndex.end())
+    {
+        return {};
+    }
+    Slot &slot = mSlots[found->second];
+    slot.referenced = true;
+    return slot.chunk;
+}
+
+TftpBlockCache::Chunk TftpBlockCache::addChunk(const TftpFileIdentity &IN_file, std::size_t IN_blocksize, uint64_t IN_chunkindex, const Chunk &IN_chunk)
+{
+    const Key key{IN_file, IN_blocksize, IN_chunkindex};
+    std::lock_guard<std::mutex> lock(mMutex);
+    ++mReadCount;
+    const auto found = mIndex.find(key);
+    if(found != mIndex.end())
+    {
+        return mSlots[found->second].chunk;
+    }
+    if(makeRoomFor(IN_chunk->size()))
+    {
+        insert(key, IN_chunk);
+    }
+    return IN_chunk;
+}
+
+std::size_t TftpBlockCache::getUsedBytes() const
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    return mUsedBytes;
+}
+
+std::size_t TftpBlockCache::getReadCount() const
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    return mReadCount;
+}
+
+std::size_t TftpBlockCache::blocksPerChunk(std::size_t IN_blocksize)
+{
+    return std::max<std::size_t>(1, CACHE_CHUNK_BYTES / IN_blocksize);
+}
+
+bool TftpBlockCache::chunkExtent(const TftpFileIdentity &IN_file, std::size_t IN_blocksize, uint64_t IN_chunkindex, uint64_t &OUT_offset, std::size_t &OUT_size)
+{
+    const uint64_t chunkbytes = static_cast<uint64_t>(blocksPerChunk(IN_blocksize)) * IN_blocksize;
+    OUT_offset = IN_chunkindex * chunkbytes;
+    if(OUT_offset > IN_file.size)
+    {
+        return false;
+    }
+    OUT_size = std::min(chunkbytes, IN_file.size - OUT_offset);
+    return true;
+}
+
+TftpBlockCache::Chunk TftpBlockCache::readChunk(int IN_fd, const Key &IN_key) const
+{
+    uint64_t offset = 0;
+    std::size_t size = 0;
+    if(!chunkExtent(IN_key.file, IN_key.blocksize, IN_key.chunkindex, offset, size))
+    {
+        return {};
+    }
+
+    std::shared_ptr<std::vector<char>> chunk = std::make_shared<std::vector<char>>(size);
+    std::size_t readbytes = 0;
+    while(readbytes < chunk->size())
+    {
+        const ssize_t result = pread(IN_fd, chunk->data() + readbytes, chunk->size() - readbytes, offset + readbytes);
+        //The file was truncated since it was opened, or could not be read
+        if(result <= 0)
+        {
+            return {};
+        }
+        readbytes += result;
+    }
+    return chunk;
+}
+
+/*!
+ * \brief Evicts chunks with the CLOCK algorithm until the given amount of bytes fits into the budget.
+ * A chunk that was used since the clock hand passed it last gets a second chance. Chunks that are held by a sender are skipped.
+ * \return false if not enough chunks could be evicted
+ */
+bool TftpBlockCache::makeRoomFor(std::size_t IN_bytes)
+{
+    if(IN_bytes > mBudgetBytes)
+    {
+        return false;
+    }
+
+    //Two rounds are enough to evict every chunk that is not held by a sender
+    std::size_t steps_left = 2 * mSlots.size();
+    while(mUsedBytes + IN_bytes > mBudgetBytes && steps_left > 0)
+    {
+        --steps_left;
+        Slot &slot = mSlots[mClockHand];
+        const std::size_t slotindex = mClockHand;
+        mClockHand = (mClockHand + 1) % mSlots.size();
+
+        if(!slot.chunk || slot.chunk.use_count() > 1)
+        {
+            continue;
+        }
+        if(slot.referenced)
+        {
+            slot.referenced = false;
+            continue;
+        }
+
+        mUsedBytes -= slot.chunk->size();
+        mIndex.erase(slot.key);
+        slot.chunk.reset();
+        mFreeSlots.push_back(slotindex);
+    }
+    return mUsedBytes + IN_bytes <= mBudgetBytes;
+}
+
+void TftpBlockCache::insert(const Key &IN_key, const Chunk &IN_chunk)
+{
+    std::size_t slotindex = mSlots.size();
+    if(!mFreeSlots.empty())
+    {
+        slotindex = mFreeSlots.back();
+        mFreeSlots.pop_back();
+    }
+    else
+    {
+        mSlots.emplace_back();
+    }
+
+    mSlots[slotindex] = Slot{IN_key, IN_chunk, true};
+    mIndex[IN_key] = slotindex;
+    mUsedBytes += IN_chunk->size();
+}
+
+std::shared_ptr<TftpCachedBlockSource> TftpCachedBlockSource::open(std::shared_ptr<TftpBlockCache> IN_cache, const std::string &IN_path, std::size_t IN_blocksize,
+                                                                   std::shared_ptr<ITftpFileIo> IN_fileio)
+{
+    if(!IN_cache)
+    {
+        return {};
+    }
+
+    const int fd = ::open(IN_path.c_str(), O_RDONLY | O_CLOEXEC);
+    if(fd < 0)
+    {
+        return {};
+    }
+
+    struct stat filestat{};
+    if(fstat(fd, &filestat) != 0 || !S_ISREG(filestat.st_mode))
+    {
+        ::close(fd);
+        return {};
+    }
+
+    TftpFileIdentity file;
+    file.device = filestat.st_dev;
+    file.inode = filestat.st_ino;
+    file.mtime_sec = filestat.st_mtim.tv_sec;
+    file.mtime_nsec = filestat.st_mtim.tv_nsec;
+    file.size = filestat.st_size;
+
+    return std::shared_ptr<TftpCachedBlockSource>(new TftpCachedBlockSource(IN_cache, fd, file, IN_blocksize, IN_fileio));
+}
+
+TftpCachedBlockSource::TftpCachedBlockSource(std::shared_ptr<TftpBlockCache> IN_cache, int IN_fd, const TftpFileIdentity &IN_file, std::size_t IN_blocksize, std::shared_ptr<ITftpFileIo> IN_fileio)
+    :mCache(IN_cache),
+    mFd(IN_fd),
+    mFile(IN_file),
+    mBlocksize(IN_blocksize),
+    mBlocksPerChunk(TftpBlockCache::blocksPerChunk(IN_blocksize)),
+    mFileIo(IN_fileio)
+{
+}
+
+TftpCachedBlockSource::~TftpCachedBlockSource()
+{
+    ::close(mFd);
+}
+
+std::optional<boost::asio::const_buffer> TftpCachedBlockSource::getBlock(uint64_t IN_blockindex)
+{
+    if(IN_blockindex * mBlocksize > mFile.size)
+    {
+        return {};
+    }
+
+    const uint64_t chunkindex = IN_blockindex / mBlocksPerChunk;
+    auto held = mHeldChunks.find(chunkindex);
+    if(held == mHeldChunks.end())
+    {
+        TftpBlockCache::Chunk chunk = mCache->getChunk(mFile, mFd, mBlocksize, chunkindex);
+        if(!chunk)
+        {
+            return {};
+        }
+        held = mHeldChunks.emplace(chunkindex, chunk).first;
+    }
+
+    const std::vector<char> &chunk = *held->second;
+    const std::size_t offset_in_chunk = (IN_blockindex % mBlocksPerChunk) * mBlocksize;
+    if(offset_in_chunk > chunk.size())
+    {
+        return {};
+    }
+    return boost::asio::const_buffer(chunk.data() + offset_in_chunk, std::min(mBlocksize, chunk.size() - offset_in_chunk));
+}
+
+void TftpCachedBlockSource::releaseBlocksBefore(uint64_t IN_blockindex)
+{
+    //Chunks are only released as a whole, once none of their blocks can be requested again
+    mHeldChunks.erase(mHeldChunks.begin(), mHeldChunks.lower_bound(IN_blockindex / mBlocksPerChunk));
+}
+
+bool TftpCachedBlockSource::prepareBlocks(uint64_t IN_firstblock, uint64_t IN_endblock, const boost::asio::any_io_executor &IN_executor, std::function<void()> IN_handler)
+{
+    //A failed read is not retried here; getBlock then reads synchronously and reports the error
+    if(!mFileIo || mReadFailed)
+    {
+        return true;
+    }
+
+    //The last block of the file is the first one that is not completely filled (possibly empty)
+    const uint64_t lastblock = mFile.size / mBlocksize;
+    IN_endblock = std::min(IN_endblock, lastblock + 1);
+    if(IN_firstblock >= IN_endblock)
+    {
+        return true;
+    }
+
+    const uint64_t endchunk = (IN_endblock - 1) / mBlocksPerChunk + 1;
+    for(uint64_t chunkindex = IN_firstblock / mBlocksPerChunk; chunkindex < endchunk; ++chunkindex)
+    {
+        if(!holdOrRead(chunkindex, IN_executor))
+        {
+            mWaiter = std::move(IN_handler);
+            return false;
+        }
+    }
+
+    //Read the next chunk while the prepared blocks are sent
+    if(endchunk <= lastblock / mBlocksPerChunk)
+    {
+        holdOrRead(endchunk, IN_executor);
+    }
+    return true;
+}
+
+bool TftpCachedBlockSource::holdOrRead(uint64_t IN_chunkindex, const boost::asio::any_io_executor &IN_executor)
+{
+    if(mHeldChunks.count(IN_chunkindex) > 0)
+    {
+        return true;
+    }
+
+    TftpBlockCache::Chunk cached = mCache->findChunk(mFile, mBlocksize, IN_chunkindex);
+    if(cached)
+    {
+        mHeldChunks.emplace(IN_chunkindex, cached);
+        return true;
+    }
+
+    uint64_t offset = 0;
+    std::size_t size = 0;
+    if(mReading || !TftpBlockCache::chunkExtent(mFile, mBlocksize, IN_chunkindex, offset, size))
+    {
+        return false;
+    }
+
+    mReading = true;
+    std::shared_ptr<std::vector<char>> chunk = std::make_shared<std::vector<char>>(size);
+    mFileIo->readAll(mFd, offset, chunk->data(), chunk->size(), IN_executor,
+                     [self = shared_from_this(), IN_chunkindex, chunk] (bool success)
+                     {
+                         self->onChunkRead(IN_chunkindex, chunk, success);
+                     });
+    return false;
+}
+
+void TftpCachedBlockSource::onChunkRead(uint64_t IN_chunkindex, const std::shared_ptr<std::vector<char>> &IN_chunk, bool IN_success)
+{
+    mReading = false;
+    if(IN_success)
+    {
+        mHeldChunks.emplace(IN_chunkindex, mCache->addChunk(mFile, mBlocksize, IN_chunkindex, IN_chunk));
+    }
+    else
+    {
+        mReadFailed = true;
+    }
+
+    if(mWaiter)
+    {
+        std::function<void()> waiter = std::move(mWaiter);
+        mWaiter = nullptr;
+        waiter();
+    }
+}
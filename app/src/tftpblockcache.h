@@ -0,0 +1,141 @@
+#ifndef TFTPBLOCKCACHE_H
+#define TFTPBLOCKCACHE_H
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <sys/types.h>
+#include "tftpblocksource.h"
+#include "tftpfileio.h"
+#include "tftphelpdefs.h"
+
+//Identifies the content of a file: a file that was replaced or modified gets a new identity, so stale cache entries are never used
+struct TftpFileIdentity
+{
+    dev_t device{0};
+    ino_t inode{0};
+    int64_t mtime_sec{0};
+    int64_t mtime_nsec{0};
+    uint64_t size{0};
+
+    bool operator==(const TftpFileIdentity &rhs) const;
+};
+
+/*
+ * Process-wide cache of file contents for all senders of a server, so that many clients reading the same file cause only one disk read per chunk.
+ * The file data is held in chunks of whole blocks, keyed by file identity, blocksize and the chunk index.
+ * Chunks are handed out by reference; a chunk stays valid for its holder even after it was evicted.
+ * When the memory budget is reached, chunks are evicted with the CLOCK algorithm. Chunks that are currently held by a sender are not evicted.
+ * */
+class TftpBlockCache
+{
+public:
+    using Chunk = std::shared_ptr<const std::vector<char>>;
+
+    TftpBlockCache(std::size_t IN_budgetbytes = DEFAULT_BLOCK_CACHE_BYTES);
+
+    //Returns the chunk of the given file, read from the file descriptor if it is not cached yet. Returns nothing if the read failed.
+    [[nodiscard]] Chunk getChunk(const TftpFileIdentity &IN_file, int IN_fd, std::size_t IN_blocksize, uint64_t IN_chunkindex);
+
+    //For chunks that are read by the caller itself: findChunk only looks the chunk up,
+    //addChunk caches a chunk that was read and returns the chunk that is cached for its key from now on (which is an earlier one if another transfer was faster)
+    [[nodiscard]] Chunk findChunk(const TftpFileIdentity &IN_file, std::size_t IN_blocksize, uint64_t IN_chunkindex);
+    [[nodiscard]] Chunk addChunk(const TftpFileIdentity &IN_file, std::size_t IN_blocksize, uint64_t IN_chunkindex, const Chunk &IN_chunk);
+
+    [[nodiscard]] std::size_t getUsedBytes() const;
+    [[nodiscard]] std::size_t getReadCount() const;
+
+    //Amount of blocks of the given blocksize in one chunk
+    [[nodiscard]] static std::size_t blocksPerChunk(std::size_t IN_blocksize);
+
+    //Position and size of the chunk in the file. Returns false if the chunk starts behind the end of the file
+    static bool chunkExtent(const TftpFileIdentity &IN_file, std::size_t IN_blocksize, uint64_t IN_chunkindex, uint64_t &OUT_offset, std::size_t &OUT_size);
+
+private:
+    struct Key
+    {
+        TftpFileIdentity file;
+        std::size_t blocksize{0};
+        uint64_t chunkindex{0};
+
+        bool operator==(const Key &rhs) const;
+    };
+
+    struct KeyHash
+    {
+        std::size_t operator()(const Key &IN_key) const;
+    };
+
+    struct Slot
+    {
+        Key key;
+        Chunk chunk;
+        bool referenced{false};
+    };
+
+    [[nodiscard]] Chunk readChunk(int IN_fd, const Key &IN_key) const;
+    bool makeRoomFor(std::size_t IN_bytes);
+    void insert(const Key &IN_key, const Chunk &IN_chunk);
+
+    std::size_t mBudgetBytes{0};
+    std::size_t mUsedBytes{0};
+    std::size_t mReadCount{0};
+
+    std::unordered_map<Key, std::size_t, KeyHash> mIndex;
+    std::vector<Slot> mSlots;
+    std::vector<std::size_t> mFreeSlots;
+    std::size_t mClockHand{0};
+
+    mutable std::mutex mMutex;
+};
+
+/*
+ * Supplies the payload of the DATA blocks of one transfer out of the server block cache.
+ * The chunks of the blocks that were not acknowledged yet are held by this source until they are released.
+ * */
+class TftpCachedBlockSource : public ITftpBlockSource, public std::enable_shared_from_this<TftpCachedBlockSource>
+{
+public:
+    //Returns nothing if the file can not be opened.
+    //With a file I/O backend, chunks that are missing in the cache are read asynchronously when the blocks are prepared, and the chunk after the prepared blocks is read ahead.
+    //Without one they are read synchronously when a block of them is requested.
+    [[nodiscard]] static std::shared_ptr<TftpCachedBlockSource> open(std::shared_ptr<TftpBlockCache> IN_cache, const std::string &IN_path, std::size_t IN_blocksize,
+                                                                     std::shared_ptr<ITftpFileIo> IN_fileio = {});
+
+    TftpCachedBlockSource(const TftpCachedBlockSource &rhs) = delete;
+    TftpCachedBlockSource& operator=(const TftpCachedBlockSource &rhs) = delete;
+
+    [[nodiscard]] std::optional<boost::asio::const_buffer> getBlock(uint64_t IN_blockindex) override;
+    void releaseBlocksBefore(uint64_t IN_blockindex) override;
+    [[nodiscard]] bool prepareBlocks(uint64_t IN_firstblock, uint64_t IN_endblock, const boost::asio::any_io_executor &IN_executor, std::function<void()> IN_handler) override;
+
+    ~TftpCachedBlockSource() override;
+
+private:
+    TftpCachedBlockSource(std::shared_ptr<TftpBlockCache> IN_cache, int IN_fd, const TftpFileIdentity &IN_file, std::size_t IN_blocksize, std::shared_ptr<ITftpFileIo> IN_fileio);
+
+    //Holds the chunk if it is cached. Otherwise starts reading it, unless a read is already running. Returns true if the chunk is held
+    bool holdOrRead(uint64_t IN_chunkindex, const boost::asio::any_io_executor &IN_executor);
+    void onChunkRead(uint64_t IN_chunkindex, const std::shared_ptr<std::vector<char>> &IN_chunk, bool IN_success);
+
+    std::shared_ptr<TftpBlockCache> mCache;
+    int mFd{-1};
+    TftpFileIdentity mFile;
+    std::size_t mBlocksize{0};
+    std::size_t mBlocksPerChunk{0};
+
+    //Chunks that contain blocks which may still be requested, by chunk index
+    std::map<uint64_t, TftpBlockCache::Chunk> mHeldChunks;
+
+    std::shared_ptr<ITftpFileIo> mFileIo;
+    //Only one chunk is read at a time. The waiter is called once it was read
+    bool mReading{false};
+    bool mReadFailed{false};
+    std::function<void()> mWaiter;
+};
+
+#endif // TFTPBLOCKCACHE_H
@@ -0,0 +1,156 @@
+#include "tftpblocksource.h"
+#include "tftphelpdefs.h"
+#include <algorithm>
+#include <limits>
+
+bool ITftpBlockSource::prepareBlocks(uint64_t, uint64_t, const boost::asio::any_io_executor&, std::function<void()>)
+{
+    return true;
+}
+
+std::size_t ITftpBlockSource::maxHeldBlocks() const
+{
+    return std::numeric_limits<std::size_t>::max();
+}
+
+/*!
+ * \brief TftpStreamBlockSource::TftpStreamBlockSource
+ * \param IN_input stream to read from. It is read sequentially, a seek only happens when a block outside the ring is requested.
+ * \param IN_blocksize
+ * \param IN_ringblocks amount of blocks held in the ring. Must be at least the windowsize, so a whole window can be resent from the ring.
+ */
+TftpStreamBlockSource::TftpStreamBlockSource(std::shared_ptr<std::istream> IN_input, std::size_t IN_blocksize, std::size_t IN_ringblocks)
+    :mInput(IN_input),
+    mBlocksize(IN_blocksize),
+    mRingBlocks(std::max<std::size_t>(IN_ringblocks, 1)),
+    mRing(mRingBlocks * mBlocksize)
+{
+}
+
+std::optional<boost::asio::const_buffer> TftpStreamBlockSource::getBlock(uint64_t IN_blockindex)
+{
+    if(!mInput)
+    {
+        return {};
+    }
+
+    //The last block of the input is the first one that is not completely filled (possibly empty)
+    if(mInputSize.has_value() && IN_blockindex > mInputSize.value() / mBlocksize)
+    {
+        return {};
+    }
+
+    //Resend of a block that was already overwritten, or a jump ahead: the ring needs to start over at that block
+    if(IN_blockindex < mFirstBlock || IN_blockindex > mEndBlock)
+    {
+        if(!restartAt(IN_blockindex))
+        {
+            return {};
+        }
+    }
+
+    if(IN_blockindex == mEndBlock)
+    {
+        if(!fillRing(IN_blockindex))
+        {
+            return {};
+        }
+    }
+
+    const std::size_t slot = IN_blockindex % mRingBlocks;
+    return boost::asio::const_buffer(mRing.data() + slot * mBlocksize, sizeOfBlock(IN_blockindex));
+}
+
+void TftpStreamBlockSource::releaseBlocksBefore(uint64_t IN_blockindex)
+{
+    mFirstNeededBlock = std::max(mFirstNeededBlock, IN_blockindex);
+}
+
+std::size_t TftpStreamBlockSource::maxHeldBlocks() const
+{
+    return mRingBlocks;
+}
+
+bool TftpStreamBlockSource::restartAt(uint64_t IN_blockindex)
+{
+    //A previous short read of the last block leaves eof and fail set, which would prevent the seek
+    mInput->clear();
+    mInput->seekg(IN_blockindex * mBlocksize);
+    if(!*mInput)
+    {
+        return false;
+    }
+    mFirstBlock = IN_blockindex;
+    mEndBlock = IN_blockindex;
+    mFirstNeededBlock = IN_blockindex;
+    return true;
+}
+
+/*!
+ * \brief Reads as many blocks as the ring can hold, starting at the requested block, with at most two reads (the ring may wrap around).
+ * Only blocks that were released are overwritten, unless the ring is too small to hold the requested block otherwise.
+ */
+bool TftpStreamBlockSource::fillRing(uint64_t IN_blockindex)
+{
+    mFirstBlock = std::max({mFirstBlock, mFirstNeededBlock, IN_blockindex + 1 >= mRingBlocks ? IN_blockindex + 1 - mRingBlocks : 0});
+    mFirstBlock = std::min(mFirstBlock, IN_blockindex);
+
+    std::size_t blocks_to_read = mFirstBlock + mRingBlocks - mEndBlock;
+    bool reached_end = false;
+    while(blocks_to_read > 0 && !reached_end)
+    {
+        const std::size_t slot = mEndBlock % mRingBlocks;
+        const std::size_t contiguous_blocks = std::min(blocks_to_read, mRingBlocks - slot);
+        if(!readIntoRing(slot, contiguous_blocks, reached_end))
+        {
+            return false;
+        }
+        blocks_to_read -= contiguous_blocks;
+    }
+    return true;
+}
+
+bool TftpStreamBlockSource::readIntoRing(std::size_t IN_slot, std::size_t IN_blockcount, bool &OUT_reachedEnd)
+{
+    mInput->read(mRing.data() + IN_slot * mBlocksize, IN_blockcount * mBlocksize);
+    const std::size_t readbytes = mInput->gcount();
+
+    //Stream error apart from simply reaching its end
+    if(mInput->bad() || (mInput->fail() && !mInput->eof()))
+    {
+        return false;
+    }
+
+    OUT_reachedEnd = readbytes < IN_blockcount * mBlocksize;
+    if(OUT_reachedEnd)
+    {
+        mInputSize = mEndBlock * mBlocksize + readbytes;
+        //The partially filled (or empty) last block is held as well
+        mEndBlock += readbytes / mBlocksize + 1;
+    }
+    else
+    {
+        mEndBlock += IN_blockcount;
+    }
+    return true;
+}
+
+std::size_t TftpStreamBlockSource::sizeOfBlock(uint64_t IN_blockindex) const
+{
+    if(mInputSize.has_value() && (IN_blockindex + 1) * mBlocksize > mInputSize.value())
+    {
+        return mInputSize.value() - IN_blockindex * mBlocksize;
+    }
+    return mBlocksize;
+}
+
+std::shared_ptr<ITftpBlockSource> makeStreamBlockSource(std::shared_ptr<std::istream> IN_input, std::size_t IN_blocksize, uint16_t IN_windowsize)
+{
+    if(!IN_input || !*IN_input)
+    {
+        return {};
+    }
+    //The peer chooses windowsize and blocksize, so the memory of the ring is capped like the buffers of the receiver
+    const std::size_t ringblocks = std::max<std::size_t>(2 * IN_windowsize, READ_AHEAD_BYTES / IN_blocksize);
+    return std::make_shared<TftpStreamBlockSource>(IN_input, IN_blocksize, std::max<std::size_t>(1, std::min(ringblocks, READ_AHEAD_RING_BYTES / IN_blocksize)));
+}
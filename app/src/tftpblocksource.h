@@ -0,0 +1,81 @@
+#ifndef TFTPBLOCKSOURCE_H
+#define TFTPBLOCKSOURCE_H
+
+#include <cstdint>
+#include <functional>
+#include <istream>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+#include <boost/asio/any_io_executor.hpp>
+#include <boost/asio/buffer.hpp>
+
+/*
+ * Supplies the payload of the DATA blocks of one transfer to a Tftpsender
+ * */
+class ITftpBlockSource
+{
+public:
+    ITftpBlockSource() = default;
+
+    //Returns the payload of the block with the given (0-based) index. Less than blocksize bytes means it is the last block of the input.
+    //The buffer stays valid at least until the block is released
+    [[nodiscard]] virtual std::optional<boost::asio::const_buffer> getBlock(uint64_t IN_blockindex) = 0;
+
+    //Blocks before the given index are not requested again
+    virtual void releaseBlocksBefore(uint64_t IN_blockindex) = 0;
+
+    //Makes sure that the blocks [IN_firstblock, IN_endblock) can be returned by getBlock without waiting for the disk.
+    //Returns true if that is already the case. Otherwise they are read asynchronously, and the handler is called on the executor once they are in memory (or could not be read).
+    //Sources that read synchronously are always ready.
+    [[nodiscard]] virtual bool prepareBlocks(uint64_t IN_firstblock, uint64_t IN_endblock, const boost::asio::any_io_executor &IN_executor, std::function<void()> IN_handler);
+
+    //Amount of consecutive blocks whose buffers stay valid at the same time. Requesting more may overwrite the earliest of them, even if they were not released
+    [[nodiscard]] virtual std::size_t maxHeldBlocks() const;
+
+    virtual ~ITftpBlockSource() = default;
+};
+
+/*
+ * Supplies the payload of the DATA blocks of one transfer from an input stream.
+ * Blocks are prefetched with large sequential reads into a ring of blocks, so that sending does not need a seek and a read per block,
+ * and resends of blocks that were not acknowledged yet are served from the ring without touching the stream.
+ * */
+class TftpStreamBlockSource : public ITftpBlockSource
+{
+public:
+    TftpStreamBlockSource(std::shared_ptr<std::istream> IN_input, std::size_t IN_blocksize, std::size_t IN_ringblocks);
+
+    [[nodiscard]] std::optional<boost::asio::const_buffer> getBlock(uint64_t IN_blockindex) override;
+
+    //Released blocks may be overwritten by the read-ahead
+    void releaseBlocksBefore(uint64_t IN_blockindex) override;
+
+    [[nodiscard]] std::size_t maxHeldBlocks() const override;
+
+private:
+    bool restartAt(uint64_t IN_blockindex);
+    bool fillRing(uint64_t IN_blockindex);
+    bool readIntoRing(std::size_t IN_slot, std::size_t IN_blockcount, bool &OUT_reachedEnd);
+
+    [[nodiscard]] std::size_t sizeOfBlock(uint64_t IN_blockindex) const;
+
+    std::shared_ptr<std::istream> mInput;
+    std::size_t mBlocksize{0};
+    std::size_t mRingBlocks{0};
+    std::vector<char> mRing;
+
+    //Blocks [mFirstBlock, mEndBlock) are currently held in the ring, block i in slot i % mRingBlocks
+    uint64_t mFirstBlock{0};
+    uint64_t mEndBlock{0};
+    uint64_t mFirstNeededBlock{0};
+
+    //Known as soon as the read-ahead hit the end of the input
+    std::optional<uint64_t> mInputSize;
+};
+
+//Creates the read-ahead ring for the given stream, large enough to hold a whole window unless that exceeds READ_AHEAD_RING_BYTES. Returns nothing if the stream is not readable
+[[nodiscard]] std::shared_ptr<ITftpBlockSource> makeStreamBlockSource(std::shared_ptr<std::istream> IN_input, std::size_t IN_blocksize, uint16_t IN_windowsize);
+
+#endif // TFTPBLOCKSOURCE_H
@@ -0,0 +1,114 @@
+#include "tftpchecksum.h"
+#include <array>
+#include <cstring>
+#if defined(__x86_64__)
+#include <nmmintrin.h>
+#elif defined(__aarch64__) && defined(__ARM_FEATURE_CRC32)
+#include <arm_acle.h>
+#endif
+
+namespace
+{
+//Reflected polynomial of CRC32C
+constexpr uint32_t CRC32C_POLYNOMIAL = 0x82F63B78u;
+
+constexpr std::array<uint32_t, 256> makeTable()
+{
+    std::array<uint32_t, 256> table{};
+    for(uint32_t byte = 0; byte < 256; ++byte)
+    {
+        uint32_t crc = byte;
+        for(int bit = 0; bit < 8; ++bit)
+        {
+            crc = (crc >> 1) ^ ((crc & 1u) ? CRC32C_POLYNOMIAL : 0u);
+        }
+        table[byte] = crc;
+    }
+    return table;
+}
+
+constexpr std::array<uint32_t, 256> CRC32C_TABLE = makeTable();
+
+uint32_t updateTable(uint32_t IN_state, const unsigned char *IN_data, std::size_t IN_size)
+{
+    for(std::size_t i = 0; i < IN_size; ++i)
+    {
+        IN_state = (IN_state >> 8) ^ CRC32C_TABLE[(IN_state ^ IN_data[i]) & 0xFFu];
+    }
+    return IN_state;
+}
+
+#if defined(__x86_64__)
+__attribute__((target("sse4.2")))
+uint32_t updateHardware(uint32_t IN_state, const unsigned char *IN_data, std::size_t IN_size)
+{
+    uint64_t state = IN_state;
+    for(; IN_size >= sizeof(uint64_t); IN_data += sizeof(uint64_t), IN_size -= sizeof(uint64_t))
+    {
+        uint64_t word;
+        std::memcpy(&word, IN_data, sizeof(word));
+        state = _mm_crc32_u64(state, word);
+    }
+    uint32_t state32 = static_cast<uint32_t>(state);
+    for(; IN_size > 0; ++IN_data, --IN_size)
+    {
+        state32 = _mm_crc32_u8(state32, *IN_data);
+    }
+    return state32;
+}
+
+bool hasHardwareCrc()
+{
+    static const bool supported = (__builtin_cpu_init(), __builtin_cpu_supports("sse4.2"));
+    return supported;
+}
+#elif defined(__aarch64__) && defined(__ARM_FEATURE_CRC32)
+uint32_t updateHardware(uint32_t IN_state, const unsigned char *IN_data, std::size_t IN_size)
+{
+    for(; IN_size >= sizeof(uint64_t); IN_data += sizeof(uint64_t), IN_size -= sizeof(uint64_t))
+    {
+        uint64_t word;
+        std::memcpy(&word, IN_data, sizeof(word));
+        IN_state = __crc32cd(IN_state, word);
+    }
+    for(; IN_size > 0; ++IN_data, --IN_size)
+    {
+        IN_state = __crc32cb(IN_state, *IN_data);
+    }
+    return IN_state;
+}
+
+bool hasHardwareCrc()
+{
+    return true;
+}
+#else
+uint32_t updateHardware(uint32_t IN_state, const unsigned char *IN_data, std::size_t IN_size)
+{
+    return updateTable(IN_state, IN_data, IN_size);
+}
+
+bool hasHardwareCrc()
+{
+    return false;
+}
+#endif
+}
+
+void TftpChecksum::update(const void *IN_data, std::size_t IN_size)
+{
+    const unsigned char *data = static_cast<const unsigned char*>(IN_data);
+    mState = hasHardwareCrc() ? updateHardware(mState, data, IN_size) : updateTable(mState, data, IN_size);
+}
+
+uint32_t TftpChecksum::value() const
+{
+    return ~mState;
+}
+
+uint32_t TftpChecksum::compute(const void *IN_data, std::size_t IN_size)
+{
+    TftpChecksum checksum;
+    checksum.update(IN_data, IN_size);
+    return checksum.value();
+}
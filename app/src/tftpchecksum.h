@@ -0,0 +1,27 @@
+#ifndef TFTPCHECKSUM_H
+#define TFTPCHECKSUM_H
+
+#include <cstddef>
+#include <cstdint>
+
+/*
+ * Streaming CRC32C (Castagnoli) of the payload of a transfer, updated as the blocks go by, so verifying a file needs no second pass over it.
+ * Uses the crc32 instruction of SSE4.2 (x86) or ARMv8 if the CPU has it, a table otherwise.
+ * */
+class TftpChecksum
+{
+public:
+    TftpChecksum() = default;
+
+    void update(const void *IN_data, std::size_t IN_size);
+
+    [[nodiscard]] uint32_t value() const;
+
+    //CRC32C of a whole buffer in one go
+    [[nodiscard]] static uint32_t compute(const void *IN_data, std::size_t IN_size);
+
+private:
+    uint32_t mState{0xFFFFFFFFu};
+};
+
+#endif // TFTPCHECKSUM_H
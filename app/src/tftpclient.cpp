@@ -92,12 +92,15 @@ void TftpClient::start(boost::asio::ip::address server_address, uint16_t IN_serv
             sock->async_receive_from(boost::asio::buffer(mRecvBuffer, mRecvBuffer.size()), mServerEndpoint, [=] (boost::system::error_code err, std::size_t receivedbytes)
                                      {
                                          timeout_no_oack.cancel();
-                                         OptionACKMessage received_oack_msg;
-                                         DataMessage received_data_msg;
-                                         if(!err && received_oack_msg.decode(std::string(mRecvBuffer.begin(), mRecvBuffer.begin() + receivedbytes)))
+                                         //The opcode decides once which message the answer is, only that one is decoded
+                                         const TftpPacketView received_packet = err ? TftpPacketView{} : parsePacket(boost::asio::buffer(mRecvBuffer, receivedbytes));
+                                         const TftpOptionACKView *received_oack = std::get_if<TftpOptionACKView>(&received_packet);
+                                         const TftpDataView *received_data = std::get_if<TftpDataView>(&received_packet);
+                                         TftpOptionTable received_oack_options;
+                                         if(received_oack && OptionACKMessage::decodeInPlace(received_oack->packet, received_oack_options))
                                          {
                                              TransactionOptionValues received_options;
-                                             if(received_options.setOptionsFromMap(received_oack_msg.getOptVals()))
+                                             if(received_options.setOptionsFromTable(received_oack_options))
                                              {
 
                                                  if(received_options.mTransferSize.has_value() && received_options.mTransferSize.value() > std::filesystem::space(mRootfolder).available)
@@ -112,10 +115,12 @@ void TftpClient::start(boost::asio::ip::address server_address, uint16_t IN_serv
                                                      std::shared_ptr<std::ostream> ofs(new std::ofstream(filepath_to_write, std::ios_base::binary));
 
                                                      const int blocksize_to_use = received_options.mBlocksize.value_or(DEFAULT_BLOCKSIZE);
-                                                     const uint8_t timeout_to_use = received_options.mTimeout.value_or(RETRANSMISSION_TIME);
+                                                     const std::chrono::milliseconds timeout_to_use = received_options.getRetransmissionTimeout();
+                                                     const uint16_t windowsize_to_use = received_options.mWindowsize.value_or(DEFAULT_WINDOWSIZE);
+                                                     const uint16_t rollover_to_use = received_options.mRollover.value_or(DEFAULT_ROLLOVER);
 
                                                      //Server expects ACK 0 packet instead of us waiting for data
-                                                     std::shared_ptr<TftpReceiver> receiver = std::make_shared<TftpReceiver>(std::move(*sock), ofs, transfermode, mServerEndpoint.address(), mServerEndpoint.port(), std::bind(&TftpClient::on_receiver_done, this, std::placeholders::_1, std::placeholders::_2), blocksize_to_use, timeout_to_use);
+                                                     std::shared_ptr<TftpReceiver> receiver = std::make_shared<TftpReceiver>(std::move(*sock), ofs, transfermode, mServerEndpoint.address(), mServerEndpoint.port(), std::bind(&TftpClient::on_receiver_done, this, std::placeholders::_1, std::placeholders::_2), blocksize_to_use, timeout_to_use, windowsize_to_use, rollover_to_use);
                                                      mTransfer_running = true;
                                                      mTransferDoneCallback = on_finish_callback;
                                                      receiver->start();
@@ -136,7 +141,7 @@ void TftpClient::start(boost::asio::ip::address server_address, uint16_t IN_serv
                                              }
                                          }
                                          //We received a data msg instead
-                                         else if(!err && received_data_msg.decode(std::string(mRecvBuffer.begin(), mRecvBuffer.begin() + receivedbytes)))
+                                         else if(received_data)
                                          {
                                              {
                                                  //Create normal receiver, with default parameters
@@ -146,7 +151,7 @@ void TftpClient::start(boost::asio::ip::address server_address, uint16_t IN_serv
 
                                                  std::shared_ptr<std::ostream> ofs(new std::ofstream(filepath_to_write, std::ios_base::binary));
 
-                                                 std::shared_ptr<TftpReceiver> receiver = std::make_shared<TftpReceiver>(std::move(*sock), ofs, transfermode, mServerEndpoint.address(), mServerEndpoint.port(), received_data_msg, std::bind(&TftpClient::on_receiver_done, this, std::placeholders::_1, std::placeholders::_2), DEFAULT_BLOCKSIZE, RETRANSMISSION_TIME);
+                                                 std::shared_ptr<TftpReceiver> receiver = std::make_shared<TftpReceiver>(std::move(*sock), ofs, transfermode, mServerEndpoint.address(), mServerEndpoint.port(), *received_data, std::bind(&TftpClient::on_receiver_done, this, std::placeholders::_1, std::placeholders::_2), DEFAULT_BLOCKSIZE, std::chrono::seconds(RETRANSMISSION_TIME));
                                                  mTransfer_running = true;
                                                  mTransferDoneCallback = on_finish_callback;
                                                  receiver->start();
@@ -172,7 +177,7 @@ void TftpClient::start(boost::asio::ip::address server_address, uint16_t IN_serv
             //Receiver is constructed without knowing remote endpoint of server - it will receive the first block as acknowledgement, or time out
             std::shared_ptr<std::ostream> ofs(new std::ofstream(filepath_to_write, std::ios_base::binary));
 
-            std::shared_ptr<TftpReceiver> receiver = std::make_shared<TftpReceiver>(std::move(*sock), ofs, transfermode, std::bind(&TftpClient::on_receiver_done, this, std::placeholders::_1, std::placeholders::_2), DEFAULT_BLOCKSIZE, RETRANSMISSION_TIME);
+            std::shared_ptr<TftpReceiver> receiver = std::make_shared<TftpReceiver>(std::move(*sock), ofs, transfermode, std::bind(&TftpClient::on_receiver_done, this, std::placeholders::_1, std::placeholders::_2), DEFAULT_BLOCKSIZE, std::chrono::seconds(RETRANSMISSION_TIME));
             mTransfer_running = true;
             mTransferDoneCallback = on_finish_callback;
             receiver->start();
@@ -224,12 +229,14 @@ void TftpClient::start(boost::asio::ip::address server_address, uint16_t IN_serv
             sock->async_receive_from(boost::asio::buffer(mRecvBuffer, mRecvBuffer.size()), mServerEndpoint, [=] (boost::system::error_code err, std::size_t receivedbytes)
                                      {
                                          timeout_no_oack.cancel();
-                                         OptionACKMessage received_oack_msg;
-                                         AckMessage received_ack_msg;
-                                         if(!err && received_oack_msg.decode(std::string(mRecvBuffer.begin(), mRecvBuffer.begin() + receivedbytes)))
+                                         //The opcode decides once which message the answer is, only that one is decoded
+                                         const TftpPacketView received_packet = err ? TftpPacketView{} : parsePacket(boost::asio::buffer(mRecvBuffer, receivedbytes));
+                                         const TftpOptionACKView *received_oack = std::get_if<TftpOptionACKView>(&received_packet);
+                                         TftpOptionTable received_oack_options;
+                                         if(received_oack && OptionACKMessage::decodeInPlace(received_oack->packet, received_oack_options))
                                          {
                                              TransactionOptionValues received_options;
-                                             if( received_options.setOptionsFromMap(received_oack_msg.getOptVals()) )
+                                             if( received_options.setOptionsFromTable(received_oack_options) )
                                              {
 
                                                  if(received_options.mTransferSize.has_value() && received_options.mTransferSize.value() != size_of_file)
@@ -245,10 +252,12 @@ void TftpClient::start(boost::asio::ip::address server_address, uint16_t IN_serv
 
 
                                                      const int blocksize_to_use = received_options.mBlocksize.value_or(DEFAULT_BLOCKSIZE);
-                                                     const uint8_t timeout_to_use = received_options.mTimeout.value_or(RETRANSMISSION_TIME);
+                                                     const std::chrono::milliseconds timeout_to_use = received_options.getRetransmissionTimeout();
+                                                     const uint16_t windowsize_to_use = received_options.mWindowsize.value_or(DEFAULT_WINDOWSIZE);
+                                                     const uint16_t rollover_to_use = received_options.mRollover.value_or(DEFAULT_ROLLOVER);
 
                                                      constexpr int ACK_TO_WAIT_FOR = 1;
-                                                     std::shared_ptr<Tftpsender> sender = std::make_shared<Tftpsender>(std::move(*sock), ifs, transfermode, mServerEndpoint.address(), mServerEndpoint.port(), ACK_TO_WAIT_FOR, std::bind(&TftpClient::on_sender_done, this, std::placeholders::_1, std::placeholders::_2), blocksize_to_use, timeout_to_use);
+                                                     std::shared_ptr<Tftpsender> sender = std::make_shared<Tftpsender>(std::move(*sock), ifs, transfermode, mServerEndpoint.address(), mServerEndpoint.port(), ACK_TO_WAIT_FOR, std::bind(&TftpClient::on_sender_done, this, std::placeholders::_1, std::placeholders::_2), blocksize_to_use, timeout_to_use, windowsize_to_use, rollover_to_use);
                                                      mTransfer_running = true;
                                                      mTransferDoneCallback = on_finish_callback;
                                                      sender->start();
@@ -269,7 +278,7 @@ void TftpClient::start(boost::asio::ip::address server_address, uint16_t IN_serv
                                              }
                                          }
                                          //We received an ack msg instead
-                                         else if(!err && received_ack_msg.decode(std::string(mRecvBuffer.begin(), mRecvBuffer.begin() + receivedbytes)))
+                                         else if(std::holds_alternative<TftpAckView>(received_packet))
                                          {
                                              {
                                                  //Create normal sender, with default parameters
@@ -280,7 +289,7 @@ void TftpClient::start(boost::asio::ip::address server_address, uint16_t IN_serv
                                                  std::shared_ptr<std::istream> ifs = std::make_shared<std::ifstream>(filepath_to_read, std::ios_base::binary);
 
                                                  constexpr int ACK_TO_WAIT_FOR = 1;
-                                                 std::shared_ptr<Tftpsender> sender = std::make_shared<Tftpsender>(std::move(*sock), ifs, transfermode, mServerEndpoint.address(), mServerEndpoint.port(), ACK_TO_WAIT_FOR, std::bind(&TftpClient::on_sender_done, this, std::placeholders::_1, std::placeholders::_2), DEFAULT_BLOCKSIZE, RETRANSMISSION_TIME);
+                                                 std::shared_ptr<Tftpsender> sender = std::make_shared<Tftpsender>(std::move(*sock), ifs, transfermode, mServerEndpoint.address(), mServerEndpoint.port(), ACK_TO_WAIT_FOR, std::bind(&TftpClient::on_sender_done, this, std::placeholders::_1, std::placeholders::_2), DEFAULT_BLOCKSIZE, std::chrono::seconds(RETRANSMISSION_TIME));
                                                  mTransfer_running = true;
                                                  mTransferDoneCallback = on_finish_callback;
                                                  sender->start();
@@ -309,7 +318,7 @@ void TftpClient::start(boost::asio::ip::address server_address, uint16_t IN_serv
             std::shared_ptr<std::istream> ifs = std::make_shared<std::ifstream>(filepath_to_read, std::ios_base::binary);
 
             constexpr int ACK_TO_WAIT_FOR = 0;
-            std::shared_ptr<Tftpsender> sender = std::make_shared<Tftpsender>(std::move(*sock), ifs, transfermode, ACK_TO_WAIT_FOR, std::bind(&TftpClient::on_sender_done, this, std::placeholders::_1, std::placeholders::_2) ,DEFAULT_BLOCKSIZE, RETRANSMISSION_TIME);
+            std::shared_ptr<Tftpsender> sender = std::make_shared<Tftpsender>(std::move(*sock), ifs, transfermode, ACK_TO_WAIT_FOR, std::bind(&TftpClient::on_sender_done, this, std::placeholders::_1, std::placeholders::_2) ,DEFAULT_BLOCKSIZE, std::chrono::seconds(RETRANSMISSION_TIME));
             mTransfer_running = true;
             mTransferDoneCallback = on_finish_callback;
             sender->start();
@@ -327,14 +336,29 @@ bool TftpClient::is_transfer_running() const
     return mTransfer_running;
 }
 
+std::optional<uint32_t> TftpClient::get_checksum() const
+{
+    return mChecksum;
+}
+
 
 void TftpClient::on_sender_done(std::shared_ptr<Tftpsender> finished_sender, TftpUserFacingErrorCode err)
 {
     mTransfer_running = false;
+    mChecksum.reset();
+    if(finished_sender && err == TftpUserFacingErrorCode::ERR_NOERR)
+    {
+        mChecksum = finished_sender->getChecksum();
+    }
     mTransferDoneCallback(this, err);
 }
 void TftpClient::on_receiver_done(std::shared_ptr<TftpReceiver> finished_receiver, TftpUserFacingErrorCode err)
 {
     mTransfer_running = false;
+    mChecksum.reset();
+    if(finished_receiver && err == TftpUserFacingErrorCode::ERR_NOERR)
+    {
+        mChecksum = finished_receiver->getChecksum();
+    }
     mTransferDoneCallback(this, err);
 }
@@ -1,6 +1,7 @@
 #ifndef TFTPCLIENT_H
 #define TFTPCLIENT_H
 
+#include <optional>
 #include <string>
 #include <boost/asio.hpp>
 #include "tftphelpdefs.h"
@@ -27,6 +28,8 @@ public:
         std::function<void(TftpClient*, TftpUserFacingErrorCode)> IN_onFinishCallback = [](TftpClient*, TftpUserFacingErrorCode){});
 
     [[nodiscard]] bool is_transfer_running() const;
+    //CRC32C of the file of the last finished transfer, computed while it was transferred
+    [[nodiscard]] std::optional<uint32_t> get_checksum() const;
 private:
     void on_sender_done(std::shared_ptr<Tftpsender> finished_sender, TftpUserFacingErrorCode err);
     void on_receiver_done(std::shared_ptr<TftpReceiver> finished_receiver, TftpUserFacingErrorCode err);
@@ -39,6 +42,7 @@ private:
     std::string mRootfolder;
 
     bool mTransfer_running = false;
+    std::optional<uint32_t> mChecksum;
 
     boost::asio::deadline_timer timeout_no_oack;
 
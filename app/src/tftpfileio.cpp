@@ -0,0 +1,275 @@
+#include "tftpfileio.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <unistd.h>
+#ifdef TTFTP_HAS_IO_URING
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+
+void ITftpFileIo::readAll(int IN_fd, uint64_t IN_offset, char *IN_buffer, std::size_t IN_size, const boost::asio::any_io_executor &IN_executor, std::function<void(bool)> IN_handler)
+{
+    if(IN_size == 0)
+    {
+        boost::asio::post(IN_executor, std::bind(std::move(IN_handler), true));
+        return;
+    }
+
+    submitRead(IN_fd, IN_offset, IN_buffer, IN_size, IN_executor,
+               [self = shared_from_this(), IN_fd, IN_offset, IN_buffer, IN_size, IN_executor, IN_handler = std::move(IN_handler)] (int64_t result) mutable
+               {
+                   if(result == -EINTR || result == -EAGAIN)
+                   {
+                       self->readAll(IN_fd, IN_offset, IN_buffer, IN_size, IN_executor, std::move(IN_handler));
+                   }
+                   //0 bytes: the file is shorter than expected
+                   else if(result <= 0)
+                   {
+                       IN_handler(false);
+                   }
+                   else
+                   {
+                       self->readAll(IN_fd, IN_offset + result, IN_buffer + result, IN_size - result, IN_executor, std::move(IN_handler));
+                   }
+               });
+}
+
+void ITftpFileIo::writeAll(int IN_fd, uint64_t IN_offset, const char *IN_buffer, std::size_t IN_size, const boost::asio::any_io_executor &IN_executor, std::function<void(bool)> IN_handler)
+{
+    if(IN_size == 0)
+    {
+        boost::asio::post(IN_executor, std::bind(std::move(IN_handler), true));
+        return;
+    }
+
+    submitWrite(IN_fd, IN_offset, IN_buffer, IN_size, IN_executor,
+                [self = shared_from_this(), IN_fd, IN_offset, IN_buffer, IN_size, IN_executor, IN_handler = std::move(IN_handler)] (int64_t result) mutable
+                {
+                    if(result == -EINTR || result == -EAGAIN)
+                    {
+                        self->writeAll(IN_fd, IN_offset, IN_buffer, IN_size, IN_executor, std::move(IN_handler));
+                    }
+                    else if(result <= 0)
+                    {
+                        IN_handler(false);
+                    }
+                    else
+                    {
+                        self->writeAll(IN_fd, IN_offset + result, IN_buffer + result, IN_size - result, IN_executor, std::move(IN_handler));
+                    }
+                });
+}
+
+TftpThreadPoolFileIo::TftpThreadPoolFileIo(unsigned int IN_threads)
+    :mPool(IN_threads)
+{
+}
+
+TftpThreadPoolFileIo::~TftpThreadPoolFileIo()
+{
+    mPool.join();
+}
+
+void TftpThreadPoolFileIo::submitRead(int IN_fd, uint64_t IN_offset, char *IN_buffer, std::size_t IN_size, const boost::asio::any_io_executor &IN_executor, std::function<void(int64_t)> IN_handler)
+{
+    boost::asio::post(mPool, [IN_fd, IN_offset, IN_buffer, IN_size, IN_executor, IN_handler = std::move(IN_handler)] () mutable
+                      {
+                          const ssize_t result = pread(IN_fd, IN_buffer, IN_size, IN_offset);
+                          boost::asio::post(IN_executor, std::bind(std::move(IN_handler), result < 0 ? -errno : result));
+                      });
+}
+
+void TftpThreadPoolFileIo::submitWrite(int IN_fd, uint64_t IN_offset, const char *IN_buffer, std::size_t IN_size, const boost::asio::any_io_executor &IN_executor, std::function<void(int64_t)> IN_handler)
+{
+    boost::asio::post(mPool, [IN_fd, IN_offset, IN_buffer, IN_size, IN_executor, IN_handler = std::move(IN_handler)] () mutable
+                      {
+                          const ssize_t result = pwrite(IN_fd, IN_buffer, IN_size, IN_offset);
+                          boost::asio::post(IN_executor, std::bind(std::move(IN_handler), result < 0 ? -errno : result));
+                      });
+}
+
+#ifdef TTFTP_HAS_IO_URING
+std::shared_ptr<TftpUringFileIo> TftpUringFileIo::create(unsigned int IN_entries)
+{
+    std::shared_ptr<TftpUringFileIo> fileio(new TftpUringFileIo());
+    if(!fileio->setup(IN_entries))
+    {
+        return {};
+    }
+    fileio->mCompletionThread = std::thread(&TftpUringFileIo::reapCompletions, fileio.get());
+    return fileio;
+}
+
+bool TftpUringFileIo::setup(unsigned int IN_entries)
+{
+    io_uring_params params{};
+    mRingFd = static_cast<int>(syscall(__NR_io_uring_setup, IN_entries, &params));
+    if(mRingFd < 0)
+    {
+        return false;
+    }
+
+    mSqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    mCqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    //Newer kernels map both rings with one mapping
+    if(params.features & IORING_FEAT_SINGLE_MMAP)
+    {
+        mSqRingSize = std::max(mSqRingSize, mCqRingSize);
+        mCqRingSize = 0;
+    }
+
+    mSqRing = mmap(nullptr, mSqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, mRingFd, IORING_OFF_SQ_RING);
+    if(mSqRing == MAP_FAILED)
+    {
+        mSqRing = nullptr;
+        return false;
+    }
+    mCqRing = mSqRing;
+    if(mCqRingSize > 0)
+    {
+        mCqRing = mmap(nullptr, mCqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, mRingFd, IORING_OFF_CQ_RING);
+        if(mCqRing == MAP_FAILED)
+        {
+            mCqRing = nullptr;
+            return false;
+        }
+    }
+    mSqesSize = params.sq_entries * sizeof(io_uring_sqe);
+    void *sqes = mmap(nullptr, mSqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, mRingFd, IORING_OFF_SQES);
+    if(sqes == MAP_FAILED)
+    {
+        return false;
+    }
+    mSqes = static_cast<io_uring_sqe*>(sqes);
+
+    char *sqring = static_cast<char*>(mSqRing);
+    mSqHead = reinterpret_cast<unsigned*>(sqring + params.sq_off.head);
+    mSqTail = reinterpret_cast<unsigned*>(sqring + params.sq_off.tail);
+    mSqMask = *reinterpret_cast<unsigned*>(sqring + params.sq_off.ring_mask);
+    mSqArray = reinterpret_cast<unsigned*>(sqring + params.sq_off.array);
+
+    char *cqring = static_cast<char*>(mCqRing);
+    mCqHead = reinterpret_cast<unsigned*>(cqring + params.cq_off.head);
+    mCqTail = reinterpret_cast<unsigned*>(cqring + params.cq_off.tail);
+    mCqMask = *reinterpret_cast<unsigned*>(cqring + params.cq_off.ring_mask);
+    mCqes = reinterpret_cast<io_uring_cqe*>(cqring + params.cq_off.cqes);
+
+    //One entry stays free for the request that stops the completion thread
+    mMaxInFlight = std::min(params.sq_entries, params.cq_entries) - 1;
+    return true;
+}
+
+TftpUringFileIo::~TftpUringFileIo()
+{
+    if(mCompletionThread.joinable())
+    {
+        //A no-op without a request tells the completion thread to stop, after everything submitted before it
+        submit(IORING_OP_NOP, -1, 0, nullptr, 0, nullptr);
+        mCompletionThread.join();
+    }
+    if(mSqes)
+    {
+        munmap(mSqes, mSqesSize);
+    }
+    if(mCqRing && mCqRing != mSqRing)
+    {
+        munmap(mCqRing, mCqRingSize);
+    }
+    if(mSqRing)
+    {
+        munmap(mSqRing, mSqRingSize);
+    }
+    if(mRingFd >= 0)
+    {
+        ::close(mRingFd);
+    }
+}
+
+void TftpUringFileIo::submitRead(int IN_fd, uint64_t IN_offset, char *IN_buffer, std::size_t IN_size, const boost::asio::any_io_executor &IN_executor, std::function<void(int64_t)> IN_handler)
+{
+    submit(IORING_OP_READ, IN_fd, IN_offset, IN_buffer, IN_size, new Request{IN_executor, std::move(IN_handler)});
+}
+
+void TftpUringFileIo::submitWrite(int IN_fd, uint64_t IN_offset, const char *IN_buffer, std::size_t IN_size, const boost::asio::any_io_executor &IN_executor, std::function<void(int64_t)> IN_handler)
+{
+    submit(IORING_OP_WRITE, IN_fd, IN_offset, IN_buffer, IN_size, new Request{IN_executor, std::move(IN_handler)});
+}
+
+void TftpUringFileIo::submit(uint8_t IN_opcode, int IN_fd, uint64_t IN_offset, const char *IN_buffer, std::size_t IN_size, Request *IN_request)
+{
+    std::unique_lock<std::mutex> lock(mSubmitMutex);
+    //The stop request may always use the entry that was kept free for it
+    mSlotFree.wait(lock, [this, IN_request] () { return mInFlight < mMaxInFlight || !IN_request; });
+    ++mInFlight;
+
+    const unsigned tail = *mSqTail;
+    const unsigned index = tail & mSqMask;
+    io_uring_sqe &sqe = mSqes[index];
+    std::memset(&sqe, 0, sizeof(sqe));
+    sqe.opcode = IN_opcode;
+    sqe.fd = IN_fd;
+    sqe.off = IN_offset;
+    sqe.addr = reinterpret_cast<uint64_t>(IN_buffer);
+    sqe.len = static_cast<uint32_t>(std::min<std::size_t>(IN_size, UINT32_MAX));
+    sqe.user_data = reinterpret_cast<uint64_t>(IN_request);
+    mSqArray[index] = index;
+    //The kernel may only see the new tail after the entry is complete
+    __atomic_store_n(mSqTail, tail + 1, __ATOMIC_RELEASE);
+
+    while(syscall(__NR_io_uring_enter, mRingFd, 1, 0, 0, nullptr, 0) < 0 && errno == EINTR)
+    {
+    }
+}
+
+/*!
+ * \brief Runs on the completion thread: waits for completed requests and posts their handlers to the executors of the requests
+ */
+void TftpUringFileIo::reapCompletions()
+{
+    bool stop = false;
+    while(!stop)
+    {
+        syscall(__NR_io_uring_enter, mRingFd, 0, 1, IORING_ENTER_GETEVENTS, nullptr, 0);
+
+        unsigned head = *mCqHead;
+        const unsigned tail = __atomic_load_n(mCqTail, __ATOMIC_ACQUIRE);
+        unsigned reaped = 0;
+        for(; head != tail; ++head, ++reaped)
+        {
+            const io_uring_cqe &cqe = mCqes[head & mCqMask];
+            Request *request = reinterpret_cast<Request*>(cqe.user_data);
+            if(!request)
+            {
+                stop = true;
+                continue;
+            }
+            boost::asio::post(request->executor, std::bind(std::move(request->handler), static_cast<int64_t>(cqe.res)));
+            delete request;
+        }
+        __atomic_store_n(mCqHead, head, __ATOMIC_RELEASE);
+
+        if(reaped > 0)
+        {
+            std::lock_guard<std::mutex> lock(mSubmitMutex);
+            mInFlight -= reaped;
+            mSlotFree.notify_all();
+        }
+    }
+}
+#endif
+
+std::shared_ptr<ITftpFileIo> makeFileIo(TftpFileIoBackend IN_backend)
+{
+#ifdef TTFTP_HAS_IO_URING
+    if(IN_backend == TftpFileIoBackend::IO_URING)
+    {
+        std::shared_ptr<ITftpFileIo> fileio = TftpUringFileIo::create();
+        if(fileio)
+        {
+            return fileio;
+        }
+    }
+#endif
+    return std::make_shared<TftpThreadPoolFileIo>();
+}
@@ -0,0 +1,124 @@
+#ifndef TFTPFILEIO_H
+#define TFTPFILEIO_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <boost/asio.hpp>
+#include "tftphelpdefs.h"
+
+#if __has_include(<linux/io_uring.h>)
+#define TTFTP_HAS_IO_URING 1
+#include <linux/io_uring.h>
+#endif
+
+enum class TftpFileIoBackend {THREADS, IO_URING};
+
+/*
+ * Asynchronous positional reads and writes of files, so that transfers do not wait for the disk on their network thread.
+ * The completion handlers are posted to the executor given with the request, usually the strand of the transfer.
+ * */
+class ITftpFileIo : public std::enable_shared_from_this<ITftpFileIo>
+{
+public:
+    ITftpFileIo() = default;
+
+    ITftpFileIo(const ITftpFileIo &rhs) = delete;
+    ITftpFileIo& operator=(const ITftpFileIo &rhs) = delete;
+
+    //Reads or writes exactly IN_size bytes. The handler gets false if the file ended before or an error occured.
+    void readAll(int IN_fd, uint64_t IN_offset, char *IN_buffer, std::size_t IN_size, const boost::asio::any_io_executor &IN_executor, std::function<void(bool)> IN_handler);
+    void writeAll(int IN_fd, uint64_t IN_offset, const char *IN_buffer, std::size_t IN_size, const boost::asio::any_io_executor &IN_executor, std::function<void(bool)> IN_handler);
+
+    virtual ~ITftpFileIo() = default;
+
+protected:
+    //A single read or write, which may transfer less than requested. The handler gets the transferred bytes or -errno.
+    virtual void submitRead(int IN_fd, uint64_t IN_offset, char *IN_buffer, std::size_t IN_size, const boost::asio::any_io_executor &IN_executor, std::function<void(int64_t)> IN_handler) = 0;
+    virtual void submitWrite(int IN_fd, uint64_t IN_offset, const char *IN_buffer, std::size_t IN_size, const boost::asio::any_io_executor &IN_executor, std::function<void(int64_t)> IN_handler) = 0;
+};
+
+/*
+ * Runs blocking pread / pwrite calls on a small pool of threads of its own.
+ * */
+class TftpThreadPoolFileIo : public ITftpFileIo
+{
+public:
+    explicit TftpThreadPoolFileIo(unsigned int IN_threads = FILE_IO_THREADS);
+    ~TftpThreadPoolFileIo() override;
+
+protected:
+    void submitRead(int IN_fd, uint64_t IN_offset, char *IN_buffer, std::size_t IN_size, const boost::asio::any_io_executor &IN_executor, std::function<void(int64_t)> IN_handler) override;
+    void submitWrite(int IN_fd, uint64_t IN_offset, const char *IN_buffer, std::size_t IN_size, const boost::asio::any_io_executor &IN_executor, std::function<void(int64_t)> IN_handler) override;
+
+private:
+    boost::asio::thread_pool mPool;
+};
+
+#ifdef TTFTP_HAS_IO_URING
+/*
+ * Submits reads and writes to an io_uring of its own, without any thread blocking on the disk.
+ * A single thread waits for the completions and hands them to the executors of the requests.
+ * The ring is set up directly through the system calls, so no additional library is needed.
+ * */
+class TftpUringFileIo : public ITftpFileIo
+{
+public:
+    //Returns nothing if the kernel does not support io_uring (or it is not permitted)
+    [[nodiscard]] static std::shared_ptr<TftpUringFileIo> create(unsigned int IN_entries = IO_URING_ENTRIES);
+
+    ~TftpUringFileIo() override;
+
+protected:
+    void submitRead(int IN_fd, uint64_t IN_offset, char *IN_buffer, std::size_t IN_size, const boost::asio::any_io_executor &IN_executor, std::function<void(int64_t)> IN_handler) override;
+    void submitWrite(int IN_fd, uint64_t IN_offset, const char *IN_buffer, std::size_t IN_size, const boost::asio::any_io_executor &IN_executor, std::function<void(int64_t)> IN_handler) override;
+
+private:
+    struct Request
+    {
+        boost::asio::any_io_executor executor;
+        std::function<void(int64_t)> handler;
+    };
+
+    TftpUringFileIo() = default;
+
+    bool setup(unsigned int IN_entries);
+    void submit(uint8_t IN_opcode, int IN_fd, uint64_t IN_offset, const char *IN_buffer, std::size_t IN_size, Request *IN_request);
+    void reapCompletions();
+
+    int mRingFd{-1};
+
+    void *mSqRing{nullptr};
+    std::size_t mSqRingSize{0};
+    void *mCqRing{nullptr};
+    std::size_t mCqRingSize{0};
+    io_uring_sqe *mSqes{nullptr};
+    std::size_t mSqesSize{0};
+
+    unsigned *mSqHead{nullptr};
+    unsigned *mSqTail{nullptr};
+    unsigned mSqMask{0};
+    unsigned *mSqArray{nullptr};
+    unsigned *mCqHead{nullptr};
+    unsigned *mCqTail{nullptr};
+    unsigned mCqMask{0};
+    io_uring_cqe *mCqes{nullptr};
+
+    //The completion queue must never overflow, so at most as many requests as it holds are in flight
+    unsigned mMaxInFlight{0};
+    unsigned mInFlight{0};
+    std::mutex mSubmitMutex;
+    std::condition_variable mSlotFree;
+
+    std::thread mCompletionThread;
+};
+#endif
+
+//Creates the requested backend. Falls back to the thread pool if io_uring is not available.
+[[nodiscard]] std::shared_ptr<ITftpFileIo> makeFileIo(TftpFileIoBackend IN_backend);
+
+#endif // TFTPFILEIO_H
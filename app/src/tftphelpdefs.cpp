@@ -1,8 +1,9 @@
 #include "tftphelpdefs.h"
+#include <algorithm>
 
-TftpMode str2mode(const std::string &mode)
+TftpMode str2mode(std::string_view mode)
 {
-    if(mode == "octet")
+    if(equalsIgnoreCase(mode, "octet"))
         return TftpMode::OCTET;    //TODO: Check how the mode is actually supplied over the network. Does it even make sense to make this a string??? It is probably just a byte
     return TftpMode::INVALID;
 }
@@ -19,6 +20,47 @@ std::string mode2str(TftpMode mode)
     }
 }
 
+/*!
+ * \brief Maps an internal block count onto the 16 bit block numbers of the wire.
+ * Block numbers 0 to 65535 are used as they are; afterwards they repeat from the rollover value (0 or 1) on.
+ */
+block_nr_t wireBlockNr(block_count_t IN_blockcount, uint16_t IN_rollover)
+{
+    if(IN_blockcount < IN_rollover)
+    {
+        return IN_blockcount;
+    }
+    const block_count_t period = 65536 - IN_rollover;
+    return IN_rollover + (IN_blockcount - IN_rollover) % period;
+}
+
+/*!
+ * \brief Maps a 16 bit block number of the wire back onto an internal block count.
+ * Of all block counts that have the given wire number, the one closest to the reference is used, so the reference should be the block that is expected next.
+ */
+block_count_t unwrapBlockNr(block_nr_t IN_wirenr, block_count_t IN_reference, uint16_t IN_rollover)
+{
+    //Only the first round of block numbers contains numbers below the rollover value
+    if(IN_wirenr < IN_rollover)
+    {
+        return IN_wirenr;
+    }
+
+    const int64_t period = 65536 - IN_rollover;
+    const int64_t reference_pos = static_cast<int64_t>(IN_reference) - IN_rollover;
+    int64_t distance = ((static_cast<int64_t>(IN_wirenr) - IN_rollover - reference_pos) % period + period) % period;
+    if(distance > period / 2)
+    {
+        distance -= period;
+    }
+    int64_t pos = reference_pos + distance;
+    if(pos < 0)
+    {
+        pos += period;
+    }
+    return static_cast<block_count_t>(pos + IN_rollover);
+}
+
 /*!
  * \brief TransactionOptionValues::getOptionsAsMap
  * \return map in TFTP format that corresponds to the internal variables
@@ -34,20 +76,45 @@ std::map<std::string, std::string> TransactionOptionValues::getOptionsAsMap() co
     {
         ret_val["timeout"] = std::to_string(mTimeout.value());
     }
+    if(mUTimeout.has_value())
+    {
+        ret_val["utimeout"] = std::to_string(mUTimeout.value());
+    }
     if(mTransferSize.has_value())
     {
         ret_val["tsize"] = std::to_string(mTransferSize.value());
     }
+    if(mWindowsize.has_value())
+    {
+        ret_val["windowsize"] = std::to_string(mWindowsize.value());
+    }
+    if(mRollover.has_value())
+    {
+        ret_val["rollover"] = std::to_string(mRollover.value());
+    }
 
     return ret_val;
 }
 
 bool TransactionOptionValues::setOptionsFromMap(const std::map<std::string, std::string>& IN_map)
 {
-    if(IN_map.find("blksize") != IN_map.end())
+    TftpOptionTable table;
+    for(auto &optVal : IN_map)
     {
-        int blksize = atoi(IN_map.at("blksize").c_str());
-        if(blksize >= 8 && blksize <= 65464)
+        if(!table.add(optVal.first, optVal.second))
+        {
+            return false;
+        }
+    }
+    return setOptionsFromTable(table);
+}
+
+bool TransactionOptionValues::setOptionsFromTable(const TftpOptionTable &IN_table)
+{
+    if(const std::optional<std::string_view> value = IN_table.find("blksize"))
+    {
+        int blksize = 0;
+        if(parseOptionNumber(*value, blksize) && blksize >= 8 && blksize <= 65464)
         {
             mBlocksize = blksize;
         }
@@ -58,10 +125,10 @@ bool TransactionOptionValues::setOptionsFromMap(const std::map<std::string, std:
         }
     }
 
-    if(IN_map.find("timeout") != IN_map.end())
+    if(const std::optional<std::string_view> value = IN_table.find("timeout"))
     {
-        const int timeout = atoi(IN_map.at("blksize").c_str());
-        if(timeout < 0 || timeout > 255)
+        int timeout = 0;
+        if(!parseOptionNumber(*value, timeout) || timeout < 1 || timeout > 255)
         {
             //TOOD: What to do with invalid values? Throw exception? Restore default values? Return a bool?
             return false;
@@ -69,20 +136,59 @@ bool TransactionOptionValues::setOptionsFromMap(const std::map<std::string, std:
         mTimeout = timeout;
     }
 
-    if(IN_map.find("tsize") != IN_map.end())
+    //Same value range as in other implementations of this option: 10 ms to 255 s
+    if(const std::optional<std::string_view> value = IN_table.find("utimeout"))
     {
-        const int tsize = atoi(IN_map.at("tsize").c_str());
+        long utimeout = 0;
+        if(!parseOptionNumber(*value, utimeout) || utimeout < 10000 || utimeout > 255000000)
+        {
+            return false;
+        }
+        mUTimeout = utimeout;
+    }
 
-        if(tsize < 0)
+    if(const std::optional<std::string_view> value = IN_table.find("tsize"))
+    {
+        //Files can be larger than 4 GB, so tsize is parsed as 64 bit value
+        uint64_t tsize = 0;
+        if(!parseOptionNumber(*value, tsize))
         {
             return false;
         }
         mTransferSize = tsize;
     }
 
+    if(const std::optional<std::string_view> value = IN_table.find("windowsize"))
+    {
+        int windowsize = 0;
+        if(!parseOptionNumber(*value, windowsize) || windowsize < 1 || windowsize > 65535)
+        {
+            return false;
+        }
+        mWindowsize = windowsize;
+    }
+
+    if(const std::optional<std::string_view> value = IN_table.find("rollover"))
+    {
+        if(*value != "0" && *value != "1")
+        {
+            return false;
+        }
+        mRollover = *value == "1" ? 1 : 0;
+    }
+
     return true;
 }
 
+std::chrono::milliseconds TransactionOptionValues::getRetransmissionTimeout() const
+{
+    if(mUTimeout.has_value())
+    {
+        return std::chrono::ceil<std::chrono::milliseconds>(std::chrono::microseconds(mUTimeout.value()));
+    }
+    return std::chrono::seconds(mTimeout.value_or(RETRANSMISSION_TIME));
+}
+
 /*!
  * \brief Checks if all option values are the default values
  * \return
@@ -93,7 +199,10 @@ bool TransactionOptionValues::isDefault() const
 
     isDefault = (not mBlocksize.has_value()
                    and not mTimeout.has_value()
-                 and not mTransferSize.has_value());
+                 and not mUTimeout.has_value()
+                 and not mTransferSize.has_value()
+                 and not mWindowsize.has_value()
+                 and not mRollover.has_value());
 
     return isDefault;
 }
@@ -138,3 +247,66 @@ std::string error_message_from_code(TftpUserFacingErrorCode errorcode)
     }
     return "UNHANDLED ERROR";
 }
+
+bool equalsIgnoreCase(std::string_view IN_lhs, std::string_view IN_rhs)
+{
+    //Only ASCII letters are folded, independent of the locale
+    auto lower = [] (char c) { return (c >= 'A' && c <= 'Z') ? static_cast<char>(c - 'A' + 'a') : c; };
+    return IN_lhs.size() == IN_rhs.size()
+           && std::equal(IN_lhs.begin(), IN_lhs.end(), IN_rhs.begin(), [&lower] (char l, char r) { return lower(l) == lower(r); });
+}
+
+bool TftpOptionTable::add(std::string_view IN_name, std::string_view IN_value)
+{
+    for(std::size_t i = 0; i < mSize; ++i)
+    {
+        if(equalsIgnoreCase(mEntries[i].name, IN_name))
+        {
+            mEntries[i].value = IN_value;
+            return true;
+        }
+    }
+    if(mSize == mEntries.size())
+    {
+        return false;
+    }
+    mEntries[mSize++] = Entry{IN_name, IN_value};
+    return true;
+}
+
+std::optional<std::string_view> TftpOptionTable::find(std::string_view IN_name) const
+{
+    for(const Entry &entry : *this)
+    {
+        if(equalsIgnoreCase(entry.name, IN_name))
+        {
+            return entry.value;
+        }
+    }
+    return {};
+}
+
+void TftpOptionTable::clear()
+{
+    mSize = 0;
+}
+
+std::size_t TftpOptionTable::size() const
+{
+    return mSize;
+}
+
+bool TftpOptionTable::empty() const
+{
+    return mSize == 0;
+}
+
+const TftpOptionTable::Entry* TftpOptionTable::begin() const
+{
+    return mEntries.data();
+}
+
+const TftpOptionTable::Entry* TftpOptionTable::end() const
+{
+    return mEntries.data() + mSize;
+}
@@ -1,9 +1,13 @@
 #ifndef TFTPHELPDEFS_H
 #define TFTPHELPDEFS_H
 
+#include <array>
+#include <charconv>
+#include <chrono>
 #include <cstdint>
 #include <optional>
 #include <string>
+#include <string_view>
 #include <map>
 
 enum class TftpOpcode : uint16_t {INVALID = 0, RRQ = 1, WRQ, DATA, ACK, ERROR, OACK};
@@ -15,10 +19,11 @@ enum class TftpUserFacingErrorCode {ERR_NOERR = 0, ERR_UNSPECIFIED = 1, ERR_OACK
 
 std::string error_message_from_code(TftpUserFacingErrorCode errorcode);
 
-[[nodiscard]] TftpMode str2mode(const std::string &mode);
+[[nodiscard]] TftpMode str2mode(std::string_view mode);
 [[nodiscard]] std::string mode2str(TftpMode mode);
 
-using block_nr_t = uint16_t;
+using block_nr_t = uint16_t; //block number as it is sent on the wire
+using block_count_t = uint64_t; //block number as it is counted internally, without rollover
 using error_code_t = uint16_t;
 
 enum class TftpErrorCode : error_code_t {ERR_FILE_NOT_FOUND = 1, ERR_ACCESS_VIOLATION = 2, ERR_DISK_FULL = 3, ERR_ILLEGAL_OP = 4, ERR_UNKNOWN_TR_ID = 5, ERR_FILE_EXISTS = 6, ERR_NO_SUCH_USER = 7, ERR_OPT_NEGOTIATION = 8};
@@ -29,9 +34,79 @@ constexpr uint16_t ERRCODELENGTH = 2;
 constexpr uint16_t BLOCKNRLENGTH = sizeof(block_nr_t);
 
 constexpr uint16_t RETRANSMISSION_TIME = 2; //in seconds
+constexpr uint16_t MIN_RETRANSMISSION_TIME_MS = 20; //lower bound of the retransmission timeout that is adapted to the round trip time
+constexpr uint16_t TIMING_WHEEL_TICK_MS = 5; //resolution of the timeouts of the transfers of a server
 constexpr uint16_t RETRANSMISSIONS_UNTIL_TIMEOUT = 4; //amount of resends before the connection is closed due to timeout
+constexpr uint16_t DALLY_TIMEOUTS = 2; //timeouts a finished receiver keeps answering retransmissions of the last block with its final ACK
 
 constexpr std::size_t DEFAULT_BLOCKSIZE = 512;
+constexpr uint16_t DEFAULT_WINDOWSIZE = 1; //rfc7440: a windowsize of 1 is the lock-step behaviour of rfc1350
+constexpr uint16_t MAX_WINDOWSIZE = 32767; //ACKs of larger windows can not be unwrapped reliably after a rollover, the server answers larger requests with this
+constexpr uint16_t DEFAULT_ROLLOVER = 0; //block number that follows block 65535, unless another one is negotiated with the rollover option
+
+constexpr std::size_t RECEIVE_BATCH_DATAGRAMS = 64; //datagrams a windowed receiver takes from its socket with one recvmmsg call at most
+constexpr std::size_t RECEIVE_BATCH_BYTES = 256 * 1024; //limits the batch of a windowed receiver for large block sizes
+constexpr std::size_t REORDER_BUFFER_BYTES = 1024 * 1024; //blocks of a window a receiver holds at most while an earlier block is missing
+constexpr std::size_t READ_AHEAD_BYTES = 64 * 1024; //amount of file data a sender reads ahead with a single read
+constexpr std::size_t READ_AHEAD_RING_BYTES = 4 * 1024 * 1024; //limits the read-ahead ring of a sender for large windows and block sizes
+constexpr std::size_t CACHE_CHUNK_BYTES = 256 * 1024; //amount of file data the server block cache reads and holds as one unit
+constexpr std::size_t DEFAULT_BLOCK_CACHE_BYTES = 64 * 1024 * 1024; //memory budget of the server block cache shared by all senders
+constexpr unsigned int DEFAULT_SERVER_THREADS = 1; //amount of threads the server runs its io_context on
+constexpr std::size_t WRITE_BEHIND_CHUNK_BYTES = 256 * 1024; //amount of received data a receiver hands to the disk writer with a single write
+constexpr std::size_t DEFAULT_WRITE_BEHIND_BYTES = 4 * 1024 * 1024; //received data a server receiver may hold before it stops acknowledging
+constexpr unsigned int WRITE_BEHIND_THREADS = 2; //threads that write the received data of all receivers to disk
+constexpr std::size_t DIRECT_IO_ALIGNMENT = 4096; //alignment of buffers, file offsets and sizes of writes that bypass the page cache (O_DIRECT)
+constexpr uint64_t DEFAULT_DIRECT_IO_THRESHOLD_BYTES = 0; //uploads announcing at least this size bypass the page cache, 0 never does
+constexpr unsigned int FILE_IO_THREADS = 4; //threads of the file I/O backend that runs blocking reads and writes off the network threads
+constexpr unsigned int IO_URING_ENTRIES = 256; //size of the submission queue of the io_uring file I/O backend
+constexpr std::size_t MAX_REQUEST_OPTIONS = 16; //option-value pairs a request or OACK may carry, requests with more are rejected
+
+//Block number on the wire for an internal block count. After block 65535, the block numbers continue at the rollover value
+[[nodiscard]] block_nr_t wireBlockNr(block_count_t IN_blockcount, uint16_t IN_rollover);
+//Internal block count for a block number from the wire, i.e. the block count with that wire number that is closest to the given reference count
+[[nodiscard]] block_count_t unwrapBlockNr(block_nr_t IN_wirenr, block_count_t IN_reference, uint16_t IN_rollover);
+
+//Option names and the mode are compared without regard to case (rfc1350, rfc2347)
+[[nodiscard]] bool equalsIgnoreCase(std::string_view IN_lhs, std::string_view IN_rhs);
+
+//Parses the whole value as decimal number, without sign, whitespace or trailing characters. Used for option values and command line arguments
+template<typename T>
+[[nodiscard]] bool parseOptionNumber(std::string_view IN_value, T &OUT_number)
+{
+    const char *end = IN_value.data() + IN_value.size();
+    const std::from_chars_result result = std::from_chars(IN_value.data(), end, OUT_number);
+    return !IN_value.empty() && result.ec == std::errc() && result.ptr == end;
+}
+
+/*
+ * Option-value pairs of a received RRQ, WRQ or OACK. Names and values refer into the packet buffer, so the table is only
+ * valid as long as that buffer is. It has a fixed capacity, filling it does not allocate.
+ * */
+class TftpOptionTable
+{
+public:
+    struct Entry
+    {
+        std::string_view name;
+        std::string_view value;
+    };
+
+    //An option that is already in the table gets the new value, as with repeated keys of a map.
+    //Returns false if the table is full
+    bool add(std::string_view IN_name, std::string_view IN_value);
+    //Value of the option with this name in any case
+    [[nodiscard]] std::optional<std::string_view> find(std::string_view IN_name) const;
+    void clear();
+
+    [[nodiscard]] std::size_t size() const;
+    [[nodiscard]] bool empty() const;
+    [[nodiscard]] const Entry* begin() const;
+    [[nodiscard]] const Entry* end() const;
+
+private:
+    std::array<Entry, MAX_REQUEST_OPTIONS> mEntries{};
+    std::size_t mSize{0};
+};
 
 //WORKAROUND!!!!
 constexpr uint16_t SERVER_LISTEN_PORT = 44500; //for debug: binding to port 69 does not work without root privileges
@@ -45,11 +120,19 @@ struct TransactionOptionValues
 
     std::optional<std::size_t> mBlocksize;
     std::optional<uint8_t> mTimeout; //Timeout time in seconds
+    std::optional<uint32_t> mUTimeout; //Timeout time in microseconds, for timeouts below one second. Takes precedence over mTimeout
     std::optional<uint64_t> mTransferSize;
+    std::optional<uint16_t> mWindowsize; //rfc7440: amount of blocks sent before an ACK is expected
+    std::optional<uint16_t> mRollover; //block number (0 or 1) that follows block 65535
 
 
     [[nodiscard]] std::map<std::string, std::string> getOptionsAsMap() const;
     bool setOptionsFromMap(const std::map<std::string, std::string>& IN_map);
+    //Option names are matched without regard to case, unknown options are ignored. Returns false if a known option has an invalid value
+    bool setOptionsFromTable(const TftpOptionTable &IN_table);
+
+    //Timeout to use for the transfer, from utimeout, timeout or the default
+    [[nodiscard]] std::chrono::milliseconds getRetransmissionTimeout() const;
 
     [[nodiscard]] bool isDefault() const;
 };
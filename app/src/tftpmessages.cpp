@@ -1,120 +1,263 @@
 #include "tftpmessages.h"
+#include "tftppacketlayout.h"
 #include <cassert>
+#include <cstring>
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
-//TODO: Dependency on asio is only here for ntohs! Does this function do anything except call the underlying socket fct.? If not, remove this include
-#include <boost/asio.hpp>
+namespace
+{
+//Length of the 0-terminated string starting at IN_pos of the packet. The end of the packet also ends the string.
+std::size_t cStringLength(const char *IN_packet, std::size_t IN_size, std::size_t IN_pos)
+{
+    if(IN_pos >= IN_size)
+    {
+        return 0;
+    }
+    const void *terminator = std::memchr(IN_packet + IN_pos, 0, IN_size - IN_pos);
+    return terminator ? static_cast<const char*>(terminator) - (IN_packet + IN_pos) : IN_size - IN_pos;
+}
+
+//A request holds filename, mode and the option-value pairs as 0-terminated fields, an OACK only the option-value pairs
+constexpr std::size_t MAX_PACKET_FIELDS = 2 + 2 * MAX_REQUEST_OPTIONS;
+using PacketFields = std::array<std::string_view, MAX_PACKET_FIELDS>;
+
+//Appends the positions of the bits set in IN_mask, which stand for 0 bytes from IN_base on
+bool addDelimiters(uint32_t IN_mask, std::size_t IN_base, std::array<std::size_t, MAX_PACKET_FIELDS> &OUT_delimiters, std::size_t &OUT_count)
+{
+    while(IN_mask != 0)
+    {
+        if(OUT_count == OUT_delimiters.size())
+            return false;
+        OUT_delimiters[OUT_count++] = IN_base + __builtin_ctz(IN_mask);
+        IN_mask &= IN_mask - 1;
+    }
+    return true;
+}
+
+/*!
+ * \brief Splits the packet from IN_pos to its end into 0-terminated fields, finding all terminators in one pass.
+ *   Where SSE2 or AVX2 is available, 16 or 32 bytes are compared at once; only whole vectors within the packet are loaded.
+ * \return false if the last field is not terminated, or if there are more fields than OUT_fields holds
+ */
+bool splitFields(const char *IN_packet, std::size_t IN_size, std::size_t IN_pos, PacketFields &OUT_fields, std::size_t &OUT_count)
+{
+    std::array<std::size_t, MAX_PACKET_FIELDS> delimiters;
+    std::size_t count = 0;
+    std::size_t pos = IN_pos;
+#if defined(__AVX2__)
+    const __m256i zeros32 = _mm256_setzero_si256();
+    for(; pos + sizeof(__m256i) <= IN_size; pos += sizeof(__m256i))
+    {
+        const __m256i bytes = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(IN_packet + pos));
+        if(!addDelimiters(static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(bytes, zeros32))), pos, delimiters, count))
+            return false;
+    }
+#endif
+#if defined(__SSE2__)
+    const __m128i zeros16 = _mm_setzero_si128();
+    for(; pos + sizeof(__m128i) <= IN_size; pos += sizeof(__m128i))
+    {
+        const __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(IN_packet + pos));
+        if(!addDelimiters(static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(bytes, zeros16))), pos, delimiters, count))
+            return false;
+    }
+#endif
+    for(; pos < IN_size; ++pos)
+    {
+        if(IN_packet[pos] == 0 && !addDelimiters(1, pos, delimiters, count))
+            return false;
+    }
+
+    //Every field ends with its terminator, nothing may follow the last one
+    if(count == 0 ? IN_pos != IN_size : delimiters[count - 1] != IN_size - 1)
+        return false;
+
+    std::size_t fieldstart = IN_pos;
+    for(std::size_t i = 0; i < count; ++i)
+    {
+        OUT_fields[i] = std::string_view(IN_packet + fieldstart, delimiters[i] - fieldstart);
+        fieldstart = delimiters[i] + 1;
+    }
+    OUT_count = count;
+    return true;
+}
+
+//Reads the option-value pairs from the fields starting at IN_first (rfc2347)
+bool decodeOptionValues(const PacketFields &IN_fields, std::size_t IN_first, std::size_t IN_count, TftpOptionTable &OUT_optVals)
+{
+    OUT_optVals.clear();
+    //Invalid option field: value is missing for the last option
+    if((IN_count - IN_first) % 2 != 0)
+        return false;
+
+    for(std::size_t i = IN_first; i < IN_count; i += 2)
+    {
+        //More options than the table holds: no real client sends that many, the packet is rejected
+        if(!OUT_optVals.add(IN_fields[i], IN_fields[i + 1]))
+            return false;
+    }
+    return true;
+}
+
+//The options of an owning message, copied out of the packet
+void copyOptionValues(const TftpOptionTable &IN_table, std::map<std::string, std::string> &OUT_optVals)
+{
+    OUT_optVals.clear();
+    for(const TftpOptionTable::Entry &optVal : IN_table)
+    {
+        OUT_optVals.emplace(optVal.name, optVal.value);
+    }
+}
+
+std::size_t optionValuesLength(const std::map<std::string, std::string> &IN_optVals)
+{
+    std::size_t length = 0;
+    for(auto &optVal : IN_optVals)
+    {
+        //the +1 are for the deliminating 0
+        length += optVal.first.size() + 1 + optVal.second.size() + 1;
+    }
+    return length;
+}
+
+char* encodeOptionValues(char *OUT_packet, const std::map<std::string, std::string> &IN_optVals)
+{
+    //Option Value pairs (both pair partners as string, 0 terminated)
+    for(auto &optVal : IN_optVals)
+    {
+        OUT_packet = std::copy(optVal.first.begin(), optVal.first.end(), OUT_packet);
+        *OUT_packet++ = 0;
+        OUT_packet = std::copy(optVal.second.begin(), optVal.second.end(), OUT_packet);
+        *OUT_packet++ = 0;
+    }
+    return OUT_packet;
+}
+}
+
+bool ITftpMessage::decode(const std::string &s)
+{
+    return decode(boost::asio::buffer(s));
+}
+
+std::string ITftpMessage::encode() const
+{
+    std::string packet(encodedSize(), 0);
+    const std::size_t encodedsize = encodeInto(boost::asio::buffer(packet));
+    assert(encodedsize == packet.size());
+    return packet;
+}
 
 /*!
- * \brief Fill request message parameters from request string that was received over the network. All integers are expected to exist in network byte order.
- * \param IN_requestStr
+ * \brief Fill request message parameters from a request packet that was received over the network. All integers are expected to exist in network byte order.
+ * \param IN_packet
  * \return Boolean that indicates whether the message was successfully decoded.
  */
-//TODO: Change decoding to work on any container using iterators, instead of only strings
-bool RequestMessage::decode(const std::string &IN_requestStr)
+bool RequestMessage::decode(boost::asio::const_buffer IN_packet)
 {
     mOptionValues.clear();
+    TftpParsedRequest request;
+    const bool valid = decodeInPlace(IN_packet, request);
+    if(request.opcode != TftpOpcode::INVALID)
+    {
+        mOpCode = request.opcode;
+    }
+    if(!valid)
+        return false;
+
+    mFilename.assign(request.filename);
+    mMode = request.mode;
+    copyOptionValues(request.options, mOptionValues);
+    return true;
+}
+
+/*!
+ * \brief Parses a request packet that was received over the network. Filename and options are views into the packet.
+ * \param IN_packet
+ * \param OUT_request
+ * \return Boolean that indicates whether the packet is a valid request
+ */
+bool RequestMessage::decodeInPlace(boost::asio::const_buffer IN_packet, TftpParsedRequest &OUT_request)
+{
+    const char *packet = static_cast<const char*>(IN_packet.data());
+    const std::size_t size = IN_packet.size();
+    OUT_request.opcode = TftpOpcode::INVALID;
+    OUT_request.options.clear();
 
     //Sanity check: needs at least space for opcode and two empty strings
     //Although the mode should not be able to be empty...
-    if(IN_requestStr.size() < OPCODELENGTH + 2)
+    if(size < OPCODELENGTH + 2)
         return false;
 
     //read opcode (2 bytes) from network:
-    uint16_t opcode = ntohs(*reinterpret_cast<const uint16_t*>((IN_requestStr.data())));
+    const uint16_t opcode = readOpcode(packet);
     //If opcode is not representable by the valid codes
     if(opcode != static_cast<uint16_t>(TftpOpcode::RRQ) && opcode != static_cast<uint16_t>(TftpOpcode::WRQ))
         return false;
-    mOpCode = static_cast<TftpOpcode> (opcode);
-
-    //start reading 0 terminated filename string after opcode (can be empty)
-    mFilename = reinterpret_cast<const char*>(IN_requestStr.data() + OPCODELENGTH);
+    OUT_request.opcode = static_cast<TftpOpcode> (opcode);
 
-    //start reading 0 terminated mode string after 0 of filename (can be empty, but this would be invalid)
-    std::string mode = reinterpret_cast<const char*>(IN_requestStr.data() + OPCODELENGTH + mFilename.size() + 1);
-    mMode = str2mode(mode);
+    //After the opcode: 0 terminated filename (can be empty), mode and the array of option-value pairs
+    PacketFields fields;
+    std::size_t fieldcount = 0;
+    if(!splitFields(packet, size, OPCODELENGTH, fields, fieldcount) || fieldcount < 2)
+        return false;
+    OUT_request.filename = fields[0];
+    OUT_request.mode = str2mode(fields[1]);
 
     //Mode could not be parsed correctly
-    if(mMode == TftpMode::INVALID)
+    if(OUT_request.mode == TftpMode::INVALID)
         return false;
 
-    //start reading array of 0-terminated option-value pairs
-    std::size_t next_str_begin_idx = OPCODELENGTH + mFilename.size() + 1 + mode.size() + 1;
-    while(next_str_begin_idx < IN_requestStr.size())
-    {
-        std::string option = reinterpret_cast<const char*>(IN_requestStr.data() + next_str_begin_idx);
-        next_str_begin_idx += option.size() + 1; //skip 0 termination
-
-        //Invalid option field: value is missing for this option
-        if(next_str_begin_idx >=  IN_requestStr.size())
-            return false;
+    return decodeOptionValues(fields, 2, fieldcount, OUT_request.options);
+}
 
-        std::string value = reinterpret_cast<const char*>(IN_requestStr.data() + next_str_begin_idx);
-        next_str_begin_idx += value.size() + 1; //skip 0 termination
-        mOptionValues[option] = value;
-    }
-    //Everything could be parsed, good to go
-    return true;
+std::size_t RequestMessage::encodedSize() const
+{
+    return OPCODELENGTH + mFilename.size() + 1 + mode2str(mMode).size() + 1 + optionValuesLength(mOptionValues);
 }
 
 /*!
- * \brief create string from request parameters. Opcode is converted to network byte order.
+ * \brief Write request parameters into the packet buffer. Opcode is converted to network byte order.
  * \return
  * \throw invalid_message_parameters if message parameters are invalid. Filename is taken as is.
  */
-std::string RequestMessage::encode() const
+std::size_t RequestMessage::encodeInto(boost::asio::mutable_buffer OUT_packet) const
 {
     if(mMode == TftpMode::INVALID || mOpCode == TftpOpcode::INVALID)
         throw err_invalid_message_parameters("Message to encode does not contain valid opcode");
 
-    std::string modestr = mode2str(mMode);
-
-    int optionValLength = 0;
-    for(auto &optVal : mOptionValues)
-    {
-        //the +1 are for the deliminating 0
-        optionValLength += optVal.first.size() + 1 + optVal.second.size() + 1;
-    }
-
-    int message_length = OPCODELENGTH + mFilename.size()+1 + modestr.size()+1 + optionValLength;
+    const std::string modestr = mode2str(mMode);
+    const std::size_t message_length = encodedSize();
     if(message_length > 512)
     {
         //See rfc 2347 for the 512 byte limitation in the request message
         throw err_invalid_message_parameters("Message to encode is too large (> 512 bytes)");
     }
-    std::vector<unsigned char> IObuffer(message_length, 0);
+    if(message_length > OUT_packet.size())
+        return 0;
 
-    auto it = IObuffer.begin();
+    char *it = static_cast<char*>(OUT_packet.data());
 
-    //fill IObuffer with request in correct format per RFC:
+    //fill buffer with request in correct format per RFC:
     //opcode(2 bytes)
-    *reinterpret_cast<uint16_t*>(&(*it)) = htons(static_cast<uint16_t>(mOpCode));
-    it += OPCODELENGTH;
+    OpcodeLayout::encode(reinterpret_cast<unsigned char*>(it), static_cast<uint16_t>(mOpCode));
+    it += OpcodeLayout::size;
 
     //filename to read (0 terminated)
     it = std::copy(mFilename.begin(), mFilename.end(), it);
-    *it = 0;
-    ++it;
+    *it++ = 0;
 
     //mode (as string, 0 terminated)
     it = std::copy(modestr.begin(), modestr.end(), it);
-    *it = 0;
-    ++it;
-
-    //Option Value pairs (both pair partners as string, 0 terminated)
-    for(auto &optVal : mOptionValues)
-    {
-        it = std::copy(optVal.first.begin(), optVal.first.end(), it);
-        *it = 0;
-        ++it;
-
-        it = std::copy(optVal.second.begin(), optVal.second.end(), it);
-        *it = 0;
-        ++it;
-    }
+    *it++ = 0;
 
-    assert(it == IObuffer.end());
+    it = encodeOptionValues(it, mOptionValues);
+    assert(it == static_cast<char*>(OUT_packet.data()) + message_length);
 
-    return std::string(IObuffer.begin(), IObuffer.end());
+    return message_length;
 }
 
 bool RequestMessage::isRRQ() const
@@ -191,60 +334,76 @@ DataMessage::DataMessage(std::size_t IN_blocksize)
 
 /*!
  * \brief Decodes data message assuming that the configured blocksize is expected to arrive from the network. Opcode and BlockNr are expected to exist in network byte order and are converted to host byte order.
- * \param IN_dataStr
+ * \param IN_packet
  * \return
  */
-//TODO: Change decoding to work on any container using iterators, instead of only strings
-bool DataMessage::decode(const std::string &IN_dataStr)
+bool DataMessage::decode(boost::asio::const_buffer IN_packet)
 {
-    //TODO: How to handle the case where more block data is sent than mBlocksize? Check sizes and throw exception? Or return false?
     //Block can be partially filled, even empty (except for control info)
-    if(IN_dataStr.size() > mBlocksize + CONTROLBYTES || IN_dataStr.size() < CONTROLBYTES)
+    boost::asio::const_buffer payload;
+    if(!decodeInPlace(IN_packet, mBlocksize, mBlockNr, payload))
         return false;
+    mOpCode = TftpOpcode::DATA;
 
-    //read opcode (2 bytes):
-    uint16_t opcode = ntohs(*reinterpret_cast<const uint16_t*>((IN_dataStr.data())));
-    if(opcode != static_cast<uint16_t>(TftpOpcode::DATA))
-        return false;
-    mOpCode = static_cast<TftpOpcode>(opcode);
-
-    uint16_t blockNr = ntohs(*reinterpret_cast<const uint16_t*>(IN_dataStr.data() + OPCODELENGTH));
-    mBlockNr = blockNr;
+    //Data can contain less than blocksize characters: internal vector should reflect that. Its memory is kept for the next packet
+    const unsigned char *data = static_cast<const unsigned char*>(payload.data());
+    mData.assign(data, data + payload.size());
 
-    //mData = std::vector<unsigned char>(mBlocksize, 0);
-    //std::copy(IN_dataStr.begin() + CONTROLBYTES, IN_dataStr.end(), mData.begin());
-
-    //Data can contain less than blocksize characters: internal vector should reflect that
-    mData = std::vector<unsigned char> (std::cbegin(IN_dataStr) + CONTROLBYTES, std::cend(IN_dataStr));
+    //Data was decoded completely
+    return true;
+}
 
-    assert(mData.size() <= mBlocksize);
+/*!
+ * \brief Checks size and opcode of the packet like decode, but only points the payload into the packet instead of copying it.
+ * The payload is only valid as long as the packet buffer is not reused.
+ */
+bool DataMessage::decodeInPlace(boost::asio::const_buffer IN_packet, std::size_t IN_blocksize, block_nr_t &OUT_blockNr, boost::asio::const_buffer &OUT_payload)
+{
+    if(IN_packet.size() > IN_blocksize + CONTROLBYTES || IN_packet.size() < CONTROLBYTES)
+        return false;
 
-    if(mData.size() < mBlocksize)
-    {
-        int test = 5;
-    }
+    const auto [opcode, blockNr] = DataHeaderLayout::decode(static_cast<const unsigned char*>(IN_packet.data()));
+    if(opcode != static_cast<uint16_t>(TftpOpcode::DATA))
+        return false;
 
-    //Data was decoded completely
+    OUT_blockNr = blockNr;
+    OUT_payload = IN_packet + CONTROLBYTES;
     return true;
 }
 
+std::size_t DataMessage::encodedSize() const
+{
+    return CONTROLBYTES + mData.size();
+}
+
 /*!
- * \brief Encodes the data message to a string to be sent over the network. Requires the opcode and blockNr as well as the data buffer to be set.
+ * \brief Encodes the data message into the packet buffer to be sent over the network. Requires the opcode and blockNr as well as the data buffer to be set.
  * Opcode and BlockNr are converted to network byte order.
  * \return
  */
-std::string DataMessage::encode() const
+std::size_t DataMessage::encodeInto(boost::asio::mutable_buffer OUT_packet) const
 {
-    //Fill buffer to encode with opcode and blockNr
-    std::vector<unsigned char> IOBuffer(mBlocksize + CONTROLBYTES, 0);
-    *reinterpret_cast<uint16_t*>(IOBuffer.data()) = htons(static_cast<uint16_t>(mOpCode));
-    *reinterpret_cast<uint16_t*>(IOBuffer.data() + OPCODELENGTH) = htons(mBlockNr);
+    if(encodedSize() > OUT_packet.size())
+        return 0;
+
+    //Fill buffer to encode with opcode and blockNr, then the data
+    const std::array<unsigned char, CONTROLBYTES> header = encodeHeader();
+    unsigned char *packet = static_cast<unsigned char*>(OUT_packet.data());
+    std::copy(header.begin(), header.end(), packet);
+    std::copy(mData.begin(), mData.end(), packet + CONTROLBYTES);
 
-    //Fill data
-    assert(mData.size() == IOBuffer.size() - CONTROLBYTES);
-    std::copy(mData.begin(), mData.end(), IOBuffer.begin() + CONTROLBYTES);
+    return encodedSize();
+}
 
-    return std::string(IOBuffer.begin(), IOBuffer.end());
+/*!
+ * \brief Encodes opcode and blockNr of the data message in network byte order, without the data itself.
+ * \return
+ */
+std::array<unsigned char, CONTROLBYTES> DataMessage::encodeHeader() const
+{
+    std::array<unsigned char, CONTROLBYTES> header;
+    DataHeaderLayout::encode(header.data(), static_cast<uint16_t>(mOpCode), mBlockNr);
+    return header;
 }
 
 /*!
@@ -282,36 +441,42 @@ AckMessage::AckMessage()
 
 /*!
  * \brief Decodes an ACK message. Opcode and BlockNr are expected to exist in network byte order and are converted to host byte order.
- * \param IN_ackStr
+ * \param IN_packet
  * \return
  */
-//TODO: Change decoding to work on any container using iterators, instead of only strings
-bool AckMessage::decode(const std::string &IN_ackStr)
+bool AckMessage::decode(boost::asio::const_buffer IN_packet)
 {
-    //read opcode (2 bytes):
-    uint16_t opcode = ntohs(*reinterpret_cast<const uint16_t*>((IN_ackStr.data())));
+    if(!AckLayout::fitsInto(IN_packet.size()))
+        return false;
+
+    //read opcode and block number (2 bytes each):
+    const auto [opcode, blockNr] = AckLayout::decode(static_cast<const unsigned char*>(IN_packet.data()));
     if(opcode != static_cast<uint16_t>(TftpOpcode::ACK))
         return false;
     mOpCode = static_cast<TftpOpcode>(opcode);
-
-    uint16_t blockNr = ntohs(*reinterpret_cast<const uint16_t*>(IN_ackStr.data() + OPCODELENGTH));
     mBlockNr = blockNr;
 
     return true;
 }
 
+std::size_t AckMessage::encodedSize() const
+{
+    return AckLayout::size;
+}
+
 /*!
  * \brief Encodes an ACK message to be sent over the network. Requires the block Nr to be set. Opcode and BlockNr are expected to be in host byte order and are converted to network byte order.
  * \return
  */
-std::string AckMessage::encode() const
+std::size_t AckMessage::encodeInto(boost::asio::mutable_buffer OUT_packet) const
 {
+    if(encodedSize() > OUT_packet.size())
+        return 0;
+
     //Fill buffer to encode with opcode and blockNr
-    std::vector<unsigned char> IOBuffer(OPCODELENGTH + BLOCKNRLENGTH, 0);
-    *reinterpret_cast<uint16_t*>(IOBuffer.data()) = htons(static_cast<uint16_t>(mOpCode));
-    *reinterpret_cast<uint16_t*>(IOBuffer.data() + OPCODELENGTH) = htons(mBlockNr);
+    AckLayout::encode(static_cast<unsigned char*>(OUT_packet.data()), static_cast<uint16_t>(mOpCode), mBlockNr);
 
-    return std::string(IOBuffer.begin(), IOBuffer.end());
+    return encodedSize();
 }
 
 block_nr_t AckMessage::getBlockNr() const
@@ -338,43 +503,46 @@ ErrorMessage::ErrorMessage()
 
 /*!
  * \brief Decodes an error message. Opcode and errorcode are expected to exist in network byte order and are converted to host byte order.
- * \param IN_errStr
+ * \param IN_packet
  * \return
  */
-bool ErrorMessage::decode(const std::string &IN_errStr)
+bool ErrorMessage::decode(boost::asio::const_buffer IN_packet)
 {
-    //read opcode (2 bytes):
-    uint16_t opcode = ntohs(*reinterpret_cast<const uint16_t*>((IN_errStr.data())));
+    if(!ErrorHeaderLayout::fitsInto(IN_packet.size()))
+        return false;
+    const char *packet = static_cast<const char*>(IN_packet.data());
+
+    //read opcode and error code (2 bytes each):
+    const auto [opcode, errorCode] = ErrorHeaderLayout::decode(reinterpret_cast<const unsigned char*>(packet));
     if(opcode != static_cast<uint16_t>(TftpOpcode::ERROR))
         return false;
     mOpCode = static_cast<TftpOpcode>(opcode);
-
-    //read error code (2 bytes):
-    uint16_t error_code = ntohs(*reinterpret_cast<const uint16_t*>((IN_errStr.data() + OPCODELENGTH)));
-
-    std::string error_message = reinterpret_cast<const char*>(IN_errStr.data() + OPCODELENGTH + ERRCODELENGTH);
-
-    mErrorCode = error_code;
-    mErrorMessage = error_message;
+    mErrorCode = errorCode;
+    mErrorMessage.assign(packet + ErrorHeaderLayout::size, cStringLength(packet, IN_packet.size(), ErrorHeaderLayout::size));
 
     return true;
 }
 
+std::size_t ErrorMessage::encodedSize() const
+{
+    return ErrorHeaderLayout::size + mErrorMessage.size();
+}
+
 /*!
  * \brief Encodes an error code message to be sent over the network. Opcode and Error code are expected to be in host byte order and are converted to network byte order.
  * \return
  */
-std::string ErrorMessage::encode() const
+std::size_t ErrorMessage::encodeInto(boost::asio::mutable_buffer OUT_packet) const
 {
-    //Fill buffer to encode with opcode and error msg
-    std::vector<unsigned char> IOBuffer(OPCODELENGTH + ERRCODELENGTH + mErrorMessage.size(), 0);
-
-    *reinterpret_cast<uint16_t*>(IOBuffer.data()) = htons(static_cast<uint16_t>(mOpCode));
-    *reinterpret_cast<uint16_t*>(IOBuffer.data() + OPCODELENGTH) = htons(mErrorCode);
+    if(encodedSize() > OUT_packet.size())
+        return 0;
 
-    std::copy(mErrorMessage.begin(), mErrorMessage.end(), IOBuffer.begin() + OPCODELENGTH + ERRCODELENGTH);
+    //Fill buffer to encode with opcode and error msg
+    unsigned char *packet = static_cast<unsigned char*>(OUT_packet.data());
+    ErrorHeaderLayout::encode(packet, static_cast<uint16_t>(mOpCode), mErrorCode);
+    std::copy(mErrorMessage.begin(), mErrorMessage.end(), packet + ErrorHeaderLayout::size);
 
-    return std::string(IOBuffer.begin(), IOBuffer.end());
+    return encodedSize();
 }
 
 void ErrorMessage::setErrorCode(error_code_t code)
@@ -413,79 +581,103 @@ const std::map<std::string, std::string>& OptionACKMessage::getOptVals() const
     return mOptionValues;
 }
 
-bool OptionACKMessage::decode(const std::string &IN_optionACKStr)
+bool OptionACKMessage::decode(boost::asio::const_buffer IN_packet)
 {
     mOptionValues.clear();
+    TftpOptionTable options;
+    if(!decodeInPlace(IN_packet, options))
+        return false;
+
+    copyOptionValues(options, mOptionValues);
+    return true;
+}
+
+bool OptionACKMessage::decodeInPlace(boost::asio::const_buffer IN_packet, TftpOptionTable &OUT_options)
+{
+    const char *packet = static_cast<const char*>(IN_packet.data());
 
     //Sanity check: needs at least space for opcode and two empty strings
     //Although the mode should not be able to be empty...
-    if(IN_optionACKStr.size() < OPCODELENGTH + 2)
+    if(IN_packet.size() < OPCODELENGTH + 2)
         return false;
 
     //read opcode (2 bytes) from network:
-    uint16_t opcode = ntohs(*reinterpret_cast<const uint16_t*>((IN_optionACKStr.data())));
+    const uint16_t opcode = readOpcode(packet);
     //If opcode is not representable by the valid codes
     if(opcode != static_cast<uint16_t>(TftpOpcode::OACK))
         return false;
-    mOpCode = static_cast<TftpOpcode> (opcode);
 
     //start reading array of 0-terminated option-value pairs
-    std::size_t next_str_begin_idx = OPCODELENGTH;
-    while(next_str_begin_idx < IN_optionACKStr.size())
-    {
-        std::string option = reinterpret_cast<const char*>(IN_optionACKStr.data() + next_str_begin_idx);
-        next_str_begin_idx += option.size() + 1; //skip 0 termination
-
-        //Invalid option field: value is missing for this option
-        if(next_str_begin_idx >=  IN_optionACKStr.size())
-            return false;
-
-        std::string value = reinterpret_cast<const char*>(IN_optionACKStr.data() + next_str_begin_idx);
-        next_str_begin_idx += value.size() + 1; //skip 0 termination
-        mOptionValues[option] = value;
-    }
-    //Everything could be parsed, good to go
-    return true;
+    PacketFields fields;
+    std::size_t fieldcount = 0;
+    if(!splitFields(packet, IN_packet.size(), OPCODELENGTH, fields, fieldcount))
+        return false;
+    return decodeOptionValues(fields, 0, fieldcount, OUT_options);
 }
 
-std::string OptionACKMessage::encode() const
+std::size_t OptionACKMessage::encodedSize() const
 {
-    //TODO: fill opcode 6, then fill value map with 0 termination
-    int optionValLength = 0;
-    for(auto &optVal : mOptionValues)
-    {
-        //the +1 are for the deliminating 0
-        optionValLength += optVal.first.size() + 1 + optVal.second.size() + 1;
-    }
+    return OPCODELENGTH + optionValuesLength(mOptionValues);
+}
 
-    int message_length = OPCODELENGTH + optionValLength;
+std::size_t OptionACKMessage::encodeInto(boost::asio::mutable_buffer OUT_packet) const
+{
+    const std::size_t message_length = encodedSize();
     if(message_length > 512)
     {
         //See rfc 2347 for the 512 byte limitation in the request message
         throw err_invalid_message_parameters("Message to encode is too large (> 512 bytes)");
     }
-    std::vector<unsigned char> IObuffer(message_length, 0);
+    if(message_length > OUT_packet.size())
+        return 0;
 
-    auto it = IObuffer.begin();
+    char *it = static_cast<char*>(OUT_packet.data());
 
-    //fill IObuffer with OACK in correct format per RFC:
+    //fill buffer with OACK in correct format per RFC:
     //opcode(2 bytes)
-    *reinterpret_cast<uint16_t*>(&(*it)) = htons(static_cast<uint16_t>(mOpCode));
-    it += OPCODELENGTH;
+    OpcodeLayout::encode(reinterpret_cast<unsigned char*>(it), static_cast<uint16_t>(mOpCode));
+    it += OpcodeLayout::size;
 
-    //Option Value pairs (both pair partners as string, 0 terminated)
-    for(auto &optVal : mOptionValues)
-    {
-        it = std::copy(optVal.first.begin(), optVal.first.end(), it);
-        *it = 0;
-        ++it;
+    it = encodeOptionValues(it, mOptionValues);
+    assert(it == static_cast<char*>(OUT_packet.data()) + message_length);
 
-        it = std::copy(optVal.second.begin(), optVal.second.end(), it);
-        *it = 0;
-        ++it;
-    }
+    return message_length;
+}
 
-    assert(it == IObuffer.end());
+TftpPacketView parsePacket(boost::asio::const_buffer IN_packet, std::size_t IN_blocksize)
+{
+    if(IN_packet.size() < OPCODELENGTH)
+        return TftpInvalidPacketView{};
 
-    return std::string(IObuffer.begin(), IObuffer.end());
+    const char *packet = static_cast<const char*>(IN_packet.data());
+    const TftpOpcode opcode = static_cast<TftpOpcode>(readOpcode(packet));
+    switch(opcode)
+    {
+    case TftpOpcode::RRQ:
+    case TftpOpcode::WRQ:
+        //Filename and mode, each with its 0 terminator
+        if(IN_packet.size() >= OPCODELENGTH + 2)
+            return TftpRequestView{opcode, IN_packet};
+        break;
+    case TftpOpcode::DATA:
+    {
+        TftpDataView data;
+        if(DataMessage::decodeInPlace(IN_packet, IN_blocksize, data.blockNr, data.payload))
+            return data;
+    }break;
+    case TftpOpcode::ACK:
+        if(AckLayout::fitsInto(IN_packet.size()))
+            return TftpAckView{BlockNrField::read(reinterpret_cast<const unsigned char*>(packet))};
+        break;
+    case TftpOpcode::ERROR:
+        if(ErrorHeaderLayout::fitsInto(IN_packet.size()))
+            return TftpErrorView{ErrorCodeField::read(reinterpret_cast<const unsigned char*>(packet)),
+                                 std::string_view(packet + ErrorHeaderLayout::size, cStringLength(packet, IN_packet.size(), ErrorHeaderLayout::size))};
+        break;
+    case TftpOpcode::OACK:
+        return TftpOptionACKView{IN_packet};
+    default:
+        break;
+    }
+    return TftpInvalidPacketView{};
 }
@@ -2,30 +2,54 @@
 #define TFTPMESSAGES_H
 
 #include "tftphelpdefs.h"
+#include <array>
 #include <stdexcept>
 #include <vector>
 #include <map>
+#include <string_view>
+#include <variant>
+#include <boost/asio/buffer.hpp>
 
 class ITftpMessage
 {
 public:
     ITftpMessage() = default;
 
-    virtual bool decode(const std::string &s) = 0;
-    [[nodiscard]] virtual std::string encode() const = 0;
+    bool decode(const std::string &s);
+    [[nodiscard]] std::string encode() const;
+
+    //Decodes a received packet straight out of the receive buffer
+    virtual bool decode(boost::asio::const_buffer IN_packet) = 0;
+    //Writes the packet to the start of the given buffer, so it can be sent from a buffer that is reused for every packet.
+    //Returns the size of the packet, or 0 if it does not fit into the buffer
+    [[nodiscard]] virtual std::size_t encodeInto(boost::asio::mutable_buffer OUT_packet) const = 0;
+    [[nodiscard]] virtual std::size_t encodedSize() const = 0;
 
     virtual ~ITftpMessage() = default;
 protected:
     TftpOpcode mOpCode{TftpOpcode::INVALID};
 };
 
+//A received RRQ or WRQ, parsed in place: filename and options refer into the packet buffer
+struct TftpParsedRequest
+{
+    TftpOpcode opcode{TftpOpcode::INVALID};
+    std::string_view filename;
+    TftpMode mode{TftpMode::INVALID};
+    TftpOptionTable options;
+};
+
 //Uses opcode 01 or 02, includes filename and mode string, plus 2 padding bytes
 //rfc2347: also add arbitrary amount of 0-terminated "optname, optvalue"-pairs
 class RequestMessage : public ITftpMessage
 {
 public:
-    bool decode(const std::string &IN_requestStr) override;
-    [[nodiscard]] std::string encode() const override;
+    using ITftpMessage::decode;
+    bool decode(boost::asio::const_buffer IN_packet) override;
+    //Parses a received request without copying filename and options out of the packet, nothing is allocated
+    [[nodiscard]] static bool decodeInPlace(boost::asio::const_buffer IN_packet, TftpParsedRequest &OUT_request);
+    [[nodiscard]] std::size_t encodeInto(boost::asio::mutable_buffer OUT_packet) const override;
+    [[nodiscard]] std::size_t encodedSize() const override;
 
     [[nodiscard]] bool isRRQ() const;
     [[nodiscard]] bool isWRQ() const;
@@ -61,8 +85,14 @@ public:
     //Message needs to know the block size in order to decode/encode properly
     DataMessage(std::size_t IN_blocksize = DEFAULT_BLOCKSIZE);
 
-    bool decode(const std::string &IN_dataStr) override;
-    [[nodiscard]] std::string encode() const override;
+    using ITftpMessage::decode;
+    bool decode(boost::asio::const_buffer IN_packet) override;
+    //Parses a received DATA packet in place: the payload refers into the packet, nothing is copied or allocated
+    [[nodiscard]] static bool decodeInPlace(boost::asio::const_buffer IN_packet, std::size_t IN_blocksize, block_nr_t &OUT_blockNr, boost::asio::const_buffer &OUT_payload);
+    [[nodiscard]] std::size_t encodeInto(boost::asio::mutable_buffer OUT_packet) const override;
+    [[nodiscard]] std::size_t encodedSize() const override;
+    //Encodes only opcode and blockNr, for sending the payload from a separate buffer
+    [[nodiscard]] std::array<unsigned char, CONTROLBYTES> encodeHeader() const;
     [[nodiscard]] std::string get_data() const;
 
     [[nodiscard]] block_nr_t getBlockNr() const;
@@ -84,8 +114,10 @@ class AckMessage : public ITftpMessage
 public:
     AckMessage();
 
-    bool decode(const std::string &IN_ackStr) override;
-    [[nodiscard]] std::string encode() const override;
+    using ITftpMessage::decode;
+    bool decode(boost::asio::const_buffer IN_packet) override;
+    [[nodiscard]] std::size_t encodeInto(boost::asio::mutable_buffer OUT_packet) const override;
+    [[nodiscard]] std::size_t encodedSize() const override;
 
     [[nodiscard]] block_nr_t getBlockNr() const;
     void setBlockNr(block_nr_t IN_nr);
@@ -100,8 +132,10 @@ class ErrorMessage : public ITftpMessage
 public:
     ErrorMessage();
 
-    bool decode(const std::string &IN_errStr) override;
-    [[nodiscard]] std::string encode() const override;
+    using ITftpMessage::decode;
+    bool decode(boost::asio::const_buffer IN_packet) override;
+    [[nodiscard]] std::size_t encodeInto(boost::asio::mutable_buffer OUT_packet) const override;
+    [[nodiscard]] std::size_t encodedSize() const override;
 
     [[nodiscard]] error_code_t getErrorCode() const;
     void setErrorCode(error_code_t code);
@@ -121,8 +155,12 @@ class OptionACKMessage : public ITftpMessage
 public:
     OptionACKMessage();
 
-    bool decode(const std::string &IN_optionACKStr) override;
-    [[nodiscard]] std::string encode() const override;
+    using ITftpMessage::decode;
+    bool decode(boost::asio::const_buffer IN_packet) override;
+    //Parses a received OACK in place: the options refer into the packet buffer
+    [[nodiscard]] static bool decodeInPlace(boost::asio::const_buffer IN_packet, TftpOptionTable &OUT_options);
+    [[nodiscard]] std::size_t encodeInto(boost::asio::mutable_buffer OUT_packet) const override;
+    [[nodiscard]] std::size_t encodedSize() const override;
 
     void setOptVals(const std::map<std::string, std::string> &IN_optVals);
     void setOptVals(std::map<std::string, std::string> &&IN_optVals);
@@ -132,6 +170,40 @@ private:
     std::map<std::string, std::string> mOptionValues;
 };
 
+/*
+ * Views of a received packet, as returned by parsePacket. They refer into the packet buffer and are only valid as long as it is not reused.
+ * Messages with strings and options keep the whole packet, so only a caller that needs the fields decodes them into the message.
+ * */
+struct TftpInvalidPacketView {};
+struct TftpRequestView
+{
+    TftpOpcode opcode{TftpOpcode::INVALID};
+    boost::asio::const_buffer packet;
+};
+struct TftpDataView
+{
+    block_nr_t blockNr{0};
+    boost::asio::const_buffer payload;
+};
+struct TftpAckView
+{
+    block_nr_t blockNr{0};
+};
+struct TftpErrorView
+{
+    error_code_t errorCode{0};
+    std::string_view message;
+};
+struct TftpOptionACKView
+{
+    boost::asio::const_buffer packet;
+};
+
+using TftpPacketView = std::variant<TftpInvalidPacketView, TftpRequestView, TftpDataView, TftpAckView, TftpErrorView, TftpOptionACKView>;
+
+//Looks at the opcode of the packet once and checks the fixed size fields of the message it belongs to, without copying or allocating
+[[nodiscard]] TftpPacketView parsePacket(boost::asio::const_buffer IN_packet, std::size_t IN_blocksize = DEFAULT_BLOCKSIZE);
+
 struct err_invalid_message_parameters : public std::runtime_error
 {
     err_invalid_message_parameters(std::string message):std::runtime_error(message) {}
@@ -0,0 +1,78 @@
+#ifndef TFTPPACKETLAYOUT_H
+#define TFTPPACKETLAYOUT_H
+
+#include "tftphelpdefs.h"
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <tuple>
+
+/*
+ * Layouts of the fixed header fields of the TFTP packets (rfc1350), resolved at compile time.
+ * Fields are read and written byte by byte in network byte order, so the packet buffer needs no alignment
+ * and the host byte order does not matter; compilers turn this into a single load or store and a byte swap.
+ * */
+
+//Unsigned 16 bit field in network byte order at a fixed offset of the packet
+template<std::size_t Offset>
+struct NetworkU16Field
+{
+    using value_type = uint16_t;
+    static constexpr std::size_t offset = Offset;
+    static constexpr std::size_t end = Offset + sizeof(value_type);
+
+    [[nodiscard]] static constexpr value_type read(const unsigned char *IN_packet)
+    {
+        return static_cast<value_type>((IN_packet[offset] << 8) | IN_packet[offset + 1]);
+    }
+
+    static constexpr void write(unsigned char *OUT_packet, value_type IN_value)
+    {
+        OUT_packet[offset] = static_cast<unsigned char>(IN_value >> 8);
+        OUT_packet[offset + 1] = static_cast<unsigned char>(IN_value);
+    }
+};
+
+//Header made of the given fields, in the order they are passed to encode and returned from decode
+template<typename... Fields>
+struct PacketHeaderLayout
+{
+    static constexpr std::size_t size = std::max({Fields::end...});
+
+    [[nodiscard]] static constexpr bool fitsInto(std::size_t IN_size)
+    {
+        return IN_size >= size;
+    }
+
+    static constexpr void encode(unsigned char *OUT_packet, typename Fields::value_type... IN_values)
+    {
+        (Fields::write(OUT_packet, IN_values), ...);
+    }
+
+    [[nodiscard]] static constexpr std::tuple<typename Fields::value_type...> decode(const unsigned char *IN_packet)
+    {
+        return {Fields::read(IN_packet)...};
+    }
+};
+
+using OpcodeField = NetworkU16Field<0>;
+using BlockNrField = NetworkU16Field<OPCODELENGTH>;
+using ErrorCodeField = NetworkU16Field<OPCODELENGTH>;
+
+using OpcodeLayout = PacketHeaderLayout<OpcodeField>;
+using DataHeaderLayout = PacketHeaderLayout<OpcodeField, BlockNrField>;
+using AckLayout = PacketHeaderLayout<OpcodeField, BlockNrField>;
+using ErrorHeaderLayout = PacketHeaderLayout<OpcodeField, ErrorCodeField>;
+
+static_assert(OpcodeLayout::size == OPCODELENGTH);
+static_assert(DataHeaderLayout::size == CONTROLBYTES);
+static_assert(AckLayout::size == OPCODELENGTH + BLOCKNRLENGTH);
+static_assert(ErrorHeaderLayout::size == OPCODELENGTH + ERRCODELENGTH);
+
+//Reads the opcode of a received packet, which must hold at least OPCODELENGTH bytes
+[[nodiscard]] inline uint16_t readOpcode(const void *IN_packet)
+{
+    return OpcodeField::read(static_cast<const unsigned char*>(IN_packet));
+}
+
+#endif // TFTPPACKETLAYOUT_H
@@ -1,5 +1,7 @@
 #include "tftpreceiver.h"
 #include "tftphelpdefs.h"
+#include <algorithm>
+#include <cstring>
 
 TftpReceiver::TftpReceiver(boost::asio::ip::udp::socket &&INsocket, std::shared_ptr<std::ostream> outputstream,
                            TftpMode INmode,
@@ -7,8 +9,12 @@ TftpReceiver::TftpReceiver(boost::asio::ip::udp::socket &&INsocket, std::shared_
                            uint16_t port,
                            std::function<void(std::shared_ptr<TftpReceiver>, TftpUserFacingErrorCode)> INoperationDoneCallback,
                            std::size_t INblocksize,
-uint8_t IN_timeout_secs)
-    :TftpReceiver(std::move(INsocket), outputstream, INmode, INoperationDoneCallback, INblocksize, IN_timeout_secs)
+                           std::chrono::milliseconds IN_timeout,
+                           uint16_t IN_windowsize,
+                           uint16_t IN_rollover,
+                           std::shared_ptr<TftpTimingWheel> IN_timingwheel,
+                           std::shared_ptr<TftpWriteBehind> IN_writebehind)
+    :TftpReceiver(std::move(INsocket), outputstream, INmode, INoperationDoneCallback, INblocksize, IN_timeout, IN_windowsize, IN_rollover, IN_timingwheel, IN_writebehind)
 {
     mLastReceivedSenderEndpoint = boost::asio::ip::udp::endpoint(remoteaddress, port);
     onConnect();
@@ -19,56 +25,103 @@ TftpReceiver::TftpReceiver(boost::asio::ip::udp::socket &&INsocket,
                            TftpMode INmode,
                            std::function<void(std::shared_ptr<TftpReceiver>, TftpUserFacingErrorCode)> INoperationDoneCallback,
                            std::size_t INblocksize,
-                           uint8_t IN_timeout_secs)
+                           std::chrono::milliseconds IN_timeout,
+                           uint16_t IN_windowsize,
+                           uint16_t IN_rollover,
+                           std::shared_ptr<TftpTimingWheel> IN_timingwheel,
+                           std::shared_ptr<TftpWriteBehind> IN_writebehind)
     :blocksize(INblocksize),
     remoteConnSocket(std::move(INsocket)),
+    windowsize(IN_windowsize),
+    rollover(IN_rollover),
     databuffer(blocksize + CONTROLBYTES),
-    readTimeoutTimer(remoteConnSocket.get_executor()),
-    timeout_seconds(IN_timeout_secs),
+    readTimeoutTimer(remoteConnSocket.get_executor(), IN_timingwheel),
+    rtt(IN_timeout),
+    dallytime(IN_timeout * DALLY_TIMEOUTS),
     mOperationDoneCallback(INoperationDoneCallback),
-    output(outputstream)
+    writebehind(IN_writebehind ? IN_writebehind : std::make_shared<TftpWriteBehind>(outputstream))
 {
     if(!remoteConnSocket.is_open())
     {
         throw std::runtime_error("Socket supplied in ctor must be open");
     }
+
+    //A window of datagrams usually arrives at once, so it is taken from the socket in one go
+    const std::size_t packetsize = blocksize + CONTROLBYTES;
+    receivebatchsize = std::max<std::size_t>(1, std::min({static_cast<std::size_t>(windowsize), RECEIVE_BATCH_DATAGRAMS, RECEIVE_BATCH_BYTES / packetsize}));
+    if(receivebatchsize > 1)
+    {
+        batchbuffers.resize(receivebatchsize * packetsize);
+        batchendpoints.resize(receivebatchsize);
+        batchiovecs.resize(receivebatchsize);
+        batchdatagrams.resize(receivebatchsize);
+        for(std::size_t slot = 0; slot < receivebatchsize; ++slot)
+        {
+            batchiovecs[slot].iov_base = batchbuffers.data() + slot * packetsize;
+            batchiovecs[slot].iov_len = packetsize;
+            batchdatagrams[slot].msg_hdr.msg_iov = &batchiovecs[slot];
+            batchdatagrams[slot].msg_hdr.msg_iovlen = 1;
+        }
+    }
+
+    //rfc7440 windows may arrive reordered. The space for held payload is only allocated once a block actually arrives early
+    if(windowsize > 1)
+    {
+        reorderslots = std::max<std::size_t>(1, std::min(static_cast<std::size_t>(windowsize), REORDER_BUFFER_BYTES / blocksize));
+        reorderblocks.assign(reorderslots, 0);
+        reordersizes.assign(reorderslots, 0);
+    }
 }
 
 /*!
- * \brief Ctor with the first data block already being supplied in a DataMessage. For Client option negotiation where server sends DATA 1 instead of OACK
+ * \brief Ctor with the first data block already being supplied as view into the received packet. For Client option negotiation where server sends DATA 1 instead of OACK
  * \param INsocket
  * \param outputstream
  * \param INmode
  * \param remoteaddress
  * \param port
- * \param IN_data_1_msg
+ * \param IN_data_1
  * \param INoperationDoneCallback
  * \param INblocksize
+ * \param IN_timeout
+ * \param IN_windowsize
+ * \param IN_rollover
  */
 TftpReceiver::TftpReceiver(boost::asio::ip::udp::socket &&INsocket,
                            std::shared_ptr<std::ostream> outputstream,
                            TftpMode INmode,
                            const boost::asio::ip::address &remoteaddress,
                            uint16_t port,
-                           const DataMessage &IN_data_1_msg,
+                           const TftpDataView &IN_data_1,
                            std::function<void(std::shared_ptr<TftpReceiver>, TftpUserFacingErrorCode err)> INoperationDoneCallback,
                            std::size_t INblocksize,
-                           uint8_t IN_timeout_secs)
-    :TftpReceiver(std::move(INsocket), outputstream, INmode, remoteaddress, port, INoperationDoneCallback, INblocksize, IN_timeout_secs)
+                           std::chrono::milliseconds IN_timeout,
+                           uint16_t IN_windowsize,
+                           uint16_t IN_rollover,
+                           std::shared_ptr<TftpTimingWheel> IN_timingwheel,
+                           std::shared_ptr<TftpWriteBehind> IN_writebehind)
+    :TftpReceiver(std::move(INsocket), outputstream, INmode, remoteaddress, port, INoperationDoneCallback, INblocksize, IN_timeout, IN_windowsize, IN_rollover, IN_timingwheel, IN_writebehind)
 {
     //Write contents of DATA 1 message into file
-    if(!output || !(*output))
+    if(!writebehind->isOpen())
     {
         sendErrorMsg(static_cast<error_t>(TftpErrorCode::ERR_ACCESS_VIOLATION), "Requested file could not be opened for output", mSenderEndpoint);
         endOperation(TftpUserFacingErrorCode::ERR_OUTPUT_FILE_OPEN);
     }
-    output->write(IN_data_1_msg.get_data().c_str(), IN_data_1_msg.get_data().size());
+    const char *data_1 = static_cast<const char*>(IN_data_1.payload.data());
+    writebehind->append(data_1, IN_data_1.payload.size());
+    checksum.update(data_1, IN_data_1.payload.size());
     lastreceiveddatacount = 1; //We have already received DATA block Nr. 1
 }
 
+uint32_t TftpReceiver::getChecksum() const
+{
+    return checksum.value();
+}
+
 void TftpReceiver::start()
 {
-    if(!output || !*output)
+    if(!writebehind->isOpen())
     {
         sendErrorMsg(static_cast<error_t>(TftpErrorCode::ERR_ACCESS_VIOLATION), "Requested file could not be opened for output", mSenderEndpoint);
         endOperation(TftpUserFacingErrorCode::ERR_OUTPUT_FILE_OPEN);
@@ -109,8 +162,10 @@ void TftpReceiver::checkReceivedBlock(boost::system::error_code err, std::size_t
             }
             else
             {
-                DataMessage received_msg(blocksize);
-                const bool valid_msg_received = received_msg.decode(std::string(databuffer.begin(), databuffer.begin() + sentbytes));
+                //The payload is handed to the write-behind straight out of the receive buffer
+                block_nr_t received_blocknr = 0;
+                boost::asio::const_buffer payload;
+                const bool valid_msg_received = DataMessage::decodeInPlace(boost::asio::buffer(receivedpacket, sentbytes), blocksize, received_blocknr, payload);
 
                 if(!valid_msg_received)
                 {
@@ -119,12 +174,23 @@ void TftpReceiver::checkReceivedBlock(boost::system::error_code err, std::size_t
                 }
                 else
                 {
-                    uint16_t dataCount = received_msg.getBlockNr();
+                    //The block number is unwrapped around the block that is expected next
+                    const block_count_t dataCount = unwrapBlockNr(received_blocknr, lastreceiveddatacount + 1, rollover);
 
                     //We received an older block that we already confirmed
                     if(dataCount <= lastreceiveddatacount)
                     {
-                        sendNextAck();
+                        //Only a resend of the latest block means that our ACK for it may have been lost. Older duplicates were delayed on the way
+                        //(or are part of a resent window), answering them would only make the sender repeat blocks again.
+                        //The same goes for the blocks of the window the sender resends after a gap ACK: they were already acknowledged when the gap was filled
+                        if(dataCount == lastreceiveddatacount && dataCount > resentwindowend)
+                        {
+                            sendNextAck();
+                        }
+                        else
+                        {
+                            startNextReceive();
+                        }
                     }
                     //We received the block that we expected next
                     else if(dataCount == lastreceiveddatacount + 1)
@@ -135,25 +201,64 @@ void TftpReceiver::checkReceivedBlock(boost::system::error_code err, std::size_t
                             onConnect();
                         }
 
-                        lastreceiveddatacount++;
                         timeoutcount = 0;
+                        if(acksenttime.has_value())
+                        {
+                            rtt.addSample(std::chrono::steady_clock::now() - acksenttime.value());
+                            acksenttime.reset();
+                        }
 
-                        //Write contents of data buffer into file
-                        if(!output || !*output)
+                        //Write contents of data buffer into file, followed by the blocks that were held because this one was missing.
+                        //An earlier write may have failed in the meantime
+                        if(writebehind->hasFailed())
                         {
                             sendErrorMsg(static_cast<error_t>(TftpErrorCode::ERR_ACCESS_VIOLATION), "Requested file could not be opened for output", mSenderEndpoint);
                             endOperation(TftpUserFacingErrorCode::ERR_OUTPUT_FILE_OPEN);
+                            return;
                         }
-                        output->write(received_msg.get_data().c_str(), received_msg.get_data().size());
+                        bool lastblock = writeBlock(payload);
+                        const block_count_t lastinorder = lastreceiveddatacount;
+                        lastblock = lastblock || writeHeldBlocks();
+                        //The sender resends its whole window after a gap ACK (go-back-N). Acknowledging the held blocks right away lets it continue behind them,
+                        //instead of finishing a window whose blocks are already here and getting out of step with our window ends
+                        const bool gapfilled = lastreceiveddatacount > lastinorder && dataCount <= resentwindowend;
 
                         //Check number of sent bytes and end connection if it is < blocksize
-                        if(sentbytes == blocksize + CONTROLBYTES)
+                        //The last ACK confirms the whole file, so it waits until everything is written
+                        if(lastblock)
                         {
-                            sendNextAck();
+                            writebehind->flush(remoteConnSocket.get_executor(), std::bind(&TftpReceiver::onFinalDataWritten, shared_from_this(), std::placeholders::_1));
+                        }
+                        //rfc7440: only the last block of a window is acknowledged
+                        else if(gapfilled || lastreceiveddatacount - lastackeddatacount >= windowsize)
+                        {
+                            sendWindowAck();
+                        }
+                        else
+                        {
+                            startNextReceive();
+                        }
+                    }
+                    //rfc7440: a block of the window is missing, or was overtaken by later ones. The later blocks are held until it arrives.
+                    //Only once the sender's window is through, the last block received in order is acknowledged, so the sender restarts the window right after it.
+                    else if(dataCount > lastreceiveddatacount + 1 && windowsize > 1)
+                    {
+                        const bool held = holdEarlyBlock(dataCount, payload);
+                        const bool windowend = dataCount >= lastackeddatacount + windowsize || sentbytes != blocksize + CONTROLBYTES;
+                        if(held && windowend)
+                        {
+                            //The missing block may still be among the datagrams that were already taken from the socket
+                            gapackpending = true;
+                            startNextReceive();
+                        }
+                        //A block that cannot be held is dropped, the broken window is only acknowledged once
+                        else if(!held && lastackeddatacount != lastreceiveddatacount)
+                        {
+                            sendGapAck();
                         }
                         else
                         {
-                            sendNextAck(true);
+                            startNextReceive();
                         }
                     }
                     else if(dataCount > lastreceiveddatacount + 1)
@@ -168,7 +273,7 @@ void TftpReceiver::checkReceivedBlock(boost::system::error_code err, std::size_t
     //Read operation momentarily cancelled by timer
     else if(err == boost::asio::error::operation_aborted)
     {
-        sendNextAck();
+        sendGapAck();
     }
     else
     {
@@ -183,7 +288,12 @@ void TftpReceiver::handleReadTimeout(boost::system::error_code err)
     if(err != boost::asio::error::operation_aborted)
     {
         remoteConnSocket.cancel();
-        timeoutcount++;
+        //Only waits for the full configured timeout count towards closing the connection, shorter waits from the round trip estimate are backed off first
+        if(rtt.isAtMaxTimeout())
+        {
+            timeoutcount++;
+        }
+        rtt.onTimeout();
         if(timeoutcount > RETRANSMISSIONS_UNTIL_TIMEOUT)
         {
             sendErrorMsg(4, "Timeout while waiting for Data Packet " + std::to_string(lastreceiveddatacount + 1), mSenderEndpoint);
@@ -206,25 +316,40 @@ void TftpReceiver::sendErrorMsg(uint16_t errorcode, const std::string &msg, boos
 
 void TftpReceiver::sendNextAck(bool lastAck)
 {
-    lastsentack.setBlockNr(lastreceiveddatacount);
-    std::shared_ptr<std::string> string_to_send = std::make_shared<std::string>(lastsentack.encode());
+    //A repeated ACK makes the round trip of the next block ambiguous
+    if(!ackwassent || lastackeddatacount != lastreceiveddatacount)
+    {
+        acksenttime = std::chrono::steady_clock::now();
+    }
+    else
+    {
+        acksenttime.reset();
+    }
+    ackwassent = true;
+    gapackpending = false;
+    lastsentack.setBlockNr(wireBlockNr(lastreceiveddatacount, rollover));
+    lastackeddatacount = lastreceiveddatacount;
+    //A previous ACK that may still be in the send queue would only be replaced by the newer one
+    const std::size_t acksize = lastsentack.encodeInto(boost::asio::buffer(ackpacket));
 
     auto self = shared_from_this();
     if(isConnected) //No point in sending an ACK into the void
     {
         if(!lastAck)
         {
-            remoteConnSocket.async_send_to(boost::asio::buffer(*string_to_send, string_to_send->size()), mSenderEndpoint,
-                                           [self, string_to_send] (boost::system::error_code err, std::size_t sentbytes)
+            remoteConnSocket.async_send_to(boost::asio::buffer(ackpacket, acksize), mSenderEndpoint,
+                                           [self] (boost::system::error_code err, std::size_t sentbytes)
                                            {
                                                self->handleACKsent(err, sentbytes);
                                            });
         }
         else
         {
-            //TODO: maybe linger for some time, in order to re-send ACK if it has not arrived at remote host
-            remoteConnSocket.send_to(boost::asio::buffer(*string_to_send, string_to_send->size()), mSenderEndpoint);
-            endOperation();
+            remoteConnSocket.async_send_to(boost::asio::buffer(ackpacket, acksize), mSenderEndpoint,
+                                           [self] (boost::system::error_code, std::size_t)
+                                           {
+                                               self->startDally();
+                                           });
         }
     }
     //If there was no message yet by the server, simply try to receive the first block again
@@ -234,11 +359,180 @@ void TftpReceiver::sendNextAck(bool lastAck)
     }
 }
 
+/*!
+ * \brief Acknowledges the last block received in order after a window did not arrive completely. If later blocks are held, the sender
+ * restarts its window right after the ACK, and the blocks of that resent window that already arrived are not answered again.
+ */
+void TftpReceiver::sendGapAck()
+{
+    //The missing block may have arrived in the meantime
+    if(hasHeldBlocks())
+    {
+        resentwindowend = lastreceiveddatacount + windowsize;
+    }
+    sendNextAck();
+}
+
+/*!
+ * \brief Acknowledges a complete window. If too much received data still waits for the disk, the ACK is held back until the writer caught up, which throttles the sender.
+ */
+void TftpReceiver::sendWindowAck()
+{
+    if(writebehind->isFull())
+    {
+        auto self = shared_from_this();
+        writebehind->waitWritable(remoteConnSocket.get_executor(), [self] () { self->sendNextAck(); });
+    }
+    else
+    {
+        sendNextAck();
+    }
+}
+
+/*!
+ * \brief Hands the payload of the next block in order to the output
+ * \return true if it was the last block of the transfer
+ */
+bool TftpReceiver::writeBlock(boost::asio::const_buffer IN_payload)
+{
+    lastreceiveddatacount++;
+    writebehind->append(static_cast<const char*>(IN_payload.data()), IN_payload.size());
+    checksum.update(IN_payload.data(), IN_payload.size());
+    return IN_payload.size() != blocksize;
+}
+
+/*!
+ * \brief Copies a block that arrived before the one expected next into its slot, unless it lies beyond the reorder buffer
+ * \return false if the block could not be held
+ */
+bool TftpReceiver::holdEarlyBlock(block_count_t IN_dataCount, boost::asio::const_buffer IN_payload)
+{
+    if(IN_dataCount > lastreceiveddatacount + 1 + reorderslots)
+    {
+        return false;
+    }
+    if(reorderbuffer.empty())
+    {
+        reorderbuffer.resize(reorderslots * blocksize);
+    }
+    const std::size_t slot = IN_dataCount % reorderslots;
+    std::memcpy(reorderbuffer.data() + slot * blocksize, IN_payload.data(), IN_payload.size());
+    reorderblocks[slot] = IN_dataCount;
+    reordersizes[slot] = IN_payload.size();
+    return true;
+}
+
+bool TftpReceiver::hasHeldBlocks() const
+{
+    return std::any_of(reorderblocks.begin(), reorderblocks.end(), [this] (block_count_t IN_block) { return IN_block > lastreceiveddatacount; });
+}
+
+/*!
+ * \brief Writes the held blocks that follow the last block received in order, until the next gap
+ * \return true if the last block of the transfer was among them
+ */
+bool TftpReceiver::writeHeldBlocks()
+{
+    if(reorderslots == 0)
+    {
+        return false;
+    }
+    for(std::size_t slot = (lastreceiveddatacount + 1) % reorderslots; reorderblocks[slot] == lastreceiveddatacount + 1; slot = (lastreceiveddatacount + 1) % reorderslots)
+    {
+        reorderblocks[slot] = 0;
+        if(writeBlock(boost::asio::buffer(reorderbuffer.data() + slot * blocksize, reordersizes[slot])))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+void TftpReceiver::onFinalDataWritten(bool success)
+{
+    if(!success)
+    {
+        sendErrorMsg(static_cast<error_t>(TftpErrorCode::ERR_DISK_FULL), "Received data could not be written", mSenderEndpoint);
+        endOperation(TftpUserFacingErrorCode::ERR_OUTPUT_FILE_OPEN);
+    }
+    else
+    {
+        sendNextAck(true);
+    }
+}
+
+/*!
+ * \brief The transfer is complete once the final ACK is sent, so it is reported right away.
+ * The socket is kept open until the dally time has passed, to answer the sender if it did not get the final ACK.
+ * Nothing waits for this, the receiver is released with its last handler.
+ */
+void TftpReceiver::startDally()
+{
+    if(operationEnded)
+    {
+        return;
+    }
+    operationEnded = true;
+    auto self = shared_from_this();
+    readTimeoutTimer.expiresAfter(dallytime, [self] (boost::system::error_code err)
+                                  {
+                                      if(err != boost::asio::error::operation_aborted)
+                                      {
+                                          self->remoteConnSocket.close();
+                                      }
+                                  });
+    dallyReceive();
+    mOperationDoneCallback(self, TftpUserFacingErrorCode::ERR_NOERR);
+}
+
+void TftpReceiver::dallyReceive()
+{
+    receivedpacket = databuffer.data();
+    remoteConnSocket.async_receive_from(boost::asio::buffer(databuffer, databuffer.size()), mLastReceivedSenderEndpoint, std::bind(&TftpReceiver::handleDallyDatagram, shared_from_this(), boost::asio::placeholders::error, boost::asio::placeholders::bytes_transferred));
+}
+
+void TftpReceiver::handleDallyDatagram(boost::system::error_code err, std::size_t sentbytes)
+{
+    //The socket was closed at the end of the dally time
+    if(err)
+    {
+        return;
+    }
+
+    //Only a retransmission of the last block by our peer is answered, anything else is ignored
+    block_nr_t received_blocknr = 0;
+    boost::asio::const_buffer payload;
+    if(mLastReceivedSenderEndpoint == mSenderEndpoint
+       && DataMessage::decodeInPlace(boost::asio::buffer(receivedpacket, sentbytes), blocksize, received_blocknr, payload)
+       && received_blocknr == wireBlockNr(lastreceiveddatacount, rollover))
+    {
+        auto self = shared_from_this();
+        remoteConnSocket.async_send_to(boost::asio::buffer(ackpacket), mSenderEndpoint, [self] (boost::system::error_code, std::size_t) {});
+    }
+    dallyReceive();
+}
+
 void TftpReceiver::startNextReceive()
 {
-    databuffer.assign(databuffer.size(), 0);
-    readTimeoutTimer.expires_from_now(boost::posix_time::seconds(timeout_seconds));
-    readTimeoutTimer.async_wait(std::bind(&TftpReceiver::handleReadTimeout, shared_from_this(), boost::asio::placeholders::error));
+    //Datagrams that were taken from the socket with the last batch come first
+    if(batchprocessed < batchreceived)
+    {
+        processNextDatagram();
+        return;
+    }
+    if(gapackpending)
+    {
+        sendGapAck();
+        return;
+    }
+    if(isConnected && receivebatchsize > 1)
+    {
+        receiveBatch();
+        return;
+    }
+
+    receivedpacket = databuffer.data();
+    readTimeoutTimer.expiresAfter(rtt.getTimeout(), std::bind(&TftpReceiver::handleReadTimeout, shared_from_this(), boost::asio::placeholders::error));
     if(isConnected)
     {
         remoteConnSocket.async_receive_from(boost::asio::buffer(databuffer, databuffer.size()), mLastReceivedSenderEndpoint, std::bind(&TftpReceiver::checkReceivedBlock, shared_from_this(), boost::asio::placeholders::error, boost::asio::placeholders::bytes_transferred));
@@ -250,6 +544,72 @@ void TftpReceiver::startNextReceive()
     }
 }
 
+/*!
+ * \brief Takes all queued datagrams, up to the batch size, from the socket with one recvmmsg call and processes them one after the other.
+ * Only if none is queued, the timeout is started and the socket is waited for.
+ */
+void TftpReceiver::receiveBatch()
+{
+    batchreceived = 0;
+    batchprocessed = 0;
+    for(std::size_t slot = 0; slot < receivebatchsize; ++slot)
+    {
+        batchdatagrams[slot].msg_hdr.msg_name = batchendpoints[slot].data();
+        batchdatagrams[slot].msg_hdr.msg_namelen = batchendpoints[slot].capacity();
+        batchdatagrams[slot].msg_hdr.msg_flags = 0;
+    }
+
+    int result = 0;
+    do
+    {
+        result = recvmmsg(remoteConnSocket.native_handle(), batchdatagrams.data(), receivebatchsize, MSG_DONTWAIT, nullptr);
+    }while(result < 0 && errno == EINTR);
+
+    if(result > 0)
+    {
+        batchreceived = result;
+        processNextDatagram();
+    }
+    else if(result < 0 && errno != EAGAIN && errno != EWOULDBLOCK)
+    {
+        checkReceivedBlock(boost::system::error_code(errno, boost::system::system_category()), 0);
+    }
+    else
+    {
+        readTimeoutTimer.expiresAfter(rtt.getTimeout(), std::bind(&TftpReceiver::handleReadTimeout, shared_from_this(), boost::asio::placeholders::error));
+        auto self = shared_from_this();
+        remoteConnSocket.async_wait(boost::asio::ip::udp::socket::wait_read, [self] (boost::system::error_code err)
+                                    {
+                                        if(err)
+                                        {
+                                            //Cancelled by the timeout, or a socket error
+                                            self->checkReceivedBlock(err, 0);
+                                        }
+                                        else
+                                        {
+                                            self->receiveBatch();
+                                        }
+                                    });
+    }
+}
+
+void TftpReceiver::processNextDatagram()
+{
+    const std::size_t slot = batchprocessed++;
+    const msghdr &header = batchdatagrams[slot].msg_hdr;
+    batchendpoints[slot].resize(header.msg_namelen);
+    mLastReceivedSenderEndpoint = batchendpoints[slot];
+    receivedpacket = batchbuffers.data() + slot * (blocksize + CONTROLBYTES);
+
+    //A datagram that did not fit into its slot was cut off, it is reported with a size larger than allowed
+    std::size_t receivedbytes = batchdatagrams[slot].msg_len;
+    if(header.msg_flags & MSG_TRUNC)
+    {
+        receivedbytes = blocksize + CONTROLBYTES + 1;
+    }
+    checkReceivedBlock(boost::system::error_code(), receivedbytes);
+}
+
 void TftpReceiver::handleFirstBlockWithoutConnect(boost::system::error_code err, std::size_t sentbytes)
 {
     readTimeoutTimer.cancel();
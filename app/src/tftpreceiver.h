@@ -3,9 +3,16 @@
 
 #include <string>
 #include <memory>
+#include <array>
 #include <boost/asio.hpp>
+#include <sys/socket.h>
+#include <sys/uio.h>
 #include "tftphelpdefs.h"
 #include "tftpmessages.h"
+#include "tftpchecksum.h"
+#include "tftprttestimator.h"
+#include "tftptimingwheel.h"
+#include "tftpwritebehind.h"
 
 //TODO: instead of adding options like blocksize individually, use one TransactionOptionValues member-object
 
@@ -23,7 +30,11 @@ public:
                  uint16_t port,
                  std::function<void(std::shared_ptr<TftpReceiver>, TftpUserFacingErrorCode err)> OperationDoneCallback = [](std::shared_ptr<TftpReceiver>, TftpUserFacingErrorCode){},
                  std::size_t blocksize = DEFAULT_BLOCKSIZE,
-                 uint8_t IN_timeout_secs = RETRANSMISSION_TIME);
+                 std::chrono::milliseconds IN_timeout = std::chrono::seconds(RETRANSMISSION_TIME),
+                 uint16_t IN_windowsize = DEFAULT_WINDOWSIZE,
+                 uint16_t IN_rollover = DEFAULT_ROLLOVER,
+                 std::shared_ptr<TftpTimingWheel> IN_timingwheel = {},
+                 std::shared_ptr<TftpWriteBehind> IN_writebehind = {});
 
     //Ctor if remote endpoint is not known yet (for client use, start by waiting for data 1)
     TftpReceiver(boost::asio::ip::udp::socket &&INsocket,
@@ -31,20 +42,31 @@ public:
                  TftpMode mode,
                  std::function<void(std::shared_ptr<TftpReceiver>, TftpUserFacingErrorCode)> OperationDoneCallback = [](std::shared_ptr<TftpReceiver>, TftpUserFacingErrorCode){},
                  std::size_t blocksize = DEFAULT_BLOCKSIZE,
-                 uint8_t IN_timeout_secs = RETRANSMISSION_TIME);
+                 std::chrono::milliseconds IN_timeout = std::chrono::seconds(RETRANSMISSION_TIME),
+                 uint16_t IN_windowsize = DEFAULT_WINDOWSIZE,
+                 uint16_t IN_rollover = DEFAULT_ROLLOVER,
+                 std::shared_ptr<TftpTimingWheel> IN_timingwheel = {},
+                 std::shared_ptr<TftpWriteBehind> IN_writebehind = {});
 
-    //Ctor if remote endpoint is known AND data message 1 is already supplied
+    //Ctor if remote endpoint is known AND data message 1 is already supplied. Its payload is taken over before the ctor returns
     TftpReceiver(boost::asio::ip::udp::socket &&INsocket,
                  std::shared_ptr<std::ostream> outputstream,
                  TftpMode mode,
                  const boost::asio::ip::address &remoteaddress,
                  uint16_t port,
-                 const DataMessage &IN_data_1_msg,
+                 const TftpDataView &IN_data_1,
                  std::function<void(std::shared_ptr<TftpReceiver>, TftpUserFacingErrorCode err)> OperationDoneCallback = [](std::shared_ptr<TftpReceiver>, TftpUserFacingErrorCode){},
                  std::size_t blocksize = DEFAULT_BLOCKSIZE,
-                 uint8_t IN_timeout_secs = RETRANSMISSION_TIME);
+                 std::chrono::milliseconds IN_timeout = std::chrono::seconds(RETRANSMISSION_TIME),
+                 uint16_t IN_windowsize = DEFAULT_WINDOWSIZE,
+                 uint16_t IN_rollover = DEFAULT_ROLLOVER,
+                 std::shared_ptr<TftpTimingWheel> IN_timingwheel = {},
+                 std::shared_ptr<TftpWriteBehind> IN_writebehind = {});
 
     void start();
+
+    //CRC32C of all payload received in order so far, i.e. of the whole file once the transfer finished
+    [[nodiscard]] uint32_t getChecksum() const;
 private:
     void sendNextAck(bool lastAck = false);
     void checkReceivedBlock(boost::system::error_code err, std::size_t sentbytes);
@@ -55,6 +77,18 @@ private:
     void handleFirstBlockWithoutConnect(boost::system::error_code err, std::size_t sentbytes);
 
     void startNextReceive();
+    void receiveBatch();
+    void processNextDatagram();
+    void sendWindowAck();
+    void sendGapAck();
+    bool writeBlock(boost::asio::const_buffer IN_payload);
+    bool holdEarlyBlock(block_count_t IN_dataCount, boost::asio::const_buffer IN_payload);
+    bool writeHeldBlocks();
+    bool hasHeldBlocks() const;
+    void onFinalDataWritten(bool success);
+    void startDally();
+    void dallyReceive();
+    void handleDallyDatagram(boost::system::error_code err, std::size_t sentbytes);
 
     void onConnect();
 
@@ -64,13 +98,45 @@ private:
     std::string filename = "";
     std::size_t blocksize{0};
     boost::asio::ip::udp::socket remoteConnSocket;
-    uint16_t lastreceiveddatacount{0};
+    //Block numbers are counted without rollover, so transfers may have more than 65535 blocks
+    block_count_t lastreceiveddatacount{0};
+    //rfc7440: only every windowsize-th block (or a block after a gap) is acknowledged
+    block_count_t lastackeddatacount{0};
+    uint16_t windowsize{DEFAULT_WINDOWSIZE};
+    uint16_t rollover{DEFAULT_ROLLOVER};
     AckMessage lastsentack{};
+    //The last ACK is encoded into this buffer and sent from it, so sending an ACK does not allocate
+    std::array<char, OPCODELENGTH + BLOCKNRLENGTH> ackpacket{};
     std::vector<char> databuffer{};
-
-    boost::asio::deadline_timer readTimeoutTimer;
+    //rfc7440 windows: all queued datagrams are taken from the socket with one recvmmsg call, one slot per datagram, and processed one after the other
+    std::size_t receivebatchsize{1};
+    std::vector<char> batchbuffers;
+    std::vector<boost::asio::ip::udp::endpoint> batchendpoints;
+    std::vector<iovec> batchiovecs;
+    std::vector<mmsghdr> batchdatagrams;
+    std::size_t batchreceived{0};
+    std::size_t batchprocessed{0};
+    //The datagram that is being processed, in the data buffer or in a slot of the batch
+    const char *receivedpacket{nullptr};
+    //rfc7440 windows: blocks that arrive before a missing one are held until the gap is filled, in the slot of their number modulo the slot count
+    std::size_t reorderslots{0};
+    std::vector<char> reorderbuffer;
+    std::vector<block_count_t> reorderblocks;
+    std::vector<std::size_t> reordersizes;
+    //The sender's window ended with a gap, it is acknowledged once the datagrams of the current batch are processed
+    bool gapackpending{false};
+    //Last block of the window the sender resends after the latest gap ACK. Duplicates up to it are not answered
+    block_count_t resentwindowend{0};
+    TftpChecksum checksum;
+
+    TftpTransferTimer readTimeoutTimer;
     uint16_t timeoutcount{0};
-    uint8_t timeout_seconds = RETRANSMISSION_TIME;
+    TftpRttEstimator rtt;
+    //Karn's rule: the round trip time is only measured from an ACK that was sent for the first time to the next block
+    std::optional<std::chrono::steady_clock::time_point> acksenttime;
+    bool ackwassent{false};
+    //rfc1350: after the final ACK, the receiver dallies for this long, in case the ACK got lost and the last block is sent again
+    std::chrono::milliseconds dallytime;
 
     std::function<void(std::shared_ptr<TftpReceiver>, TftpUserFacingErrorCode)> mOperationDoneCallback;
 
@@ -79,7 +145,8 @@ private:
     bool isConnected = false;
     bool operationEnded = false;
 
-    std::shared_ptr<std::ostream> output;
+    //Received data goes through this into the output. Without one given, the output stream is written directly.
+    std::shared_ptr<TftpWriteBehind> writebehind;
 };
 
 #endif // TFTPRECEIVER_H
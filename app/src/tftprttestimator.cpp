@@ -0,0 +1,50 @@
+#include "tftprttestimator.h"
+#include "tftphelpdefs.h"
+#include <algorithm>
+
+/*!
+ * \brief TftpRttEstimator::TftpRttEstimator
+ * \param IN_maxtimeout negotiated timeout of the transfer. It is the initial timeout, and the timeout is never backed off beyond it.
+ */
+TftpRttEstimator::TftpRttEstimator(std::chrono::milliseconds IN_maxtimeout)
+    :mMaxTimeout(IN_maxtimeout),
+    mTimeout(IN_maxtimeout)
+{
+}
+
+/*!
+ * \brief Updates the estimate with a measured round trip time and recalculates the timeout from it, which also ends any backoff
+ */
+void TftpRttEstimator::addSample(std::chrono::steady_clock::duration IN_rtt)
+{
+    const std::chrono::microseconds rtt = std::chrono::duration_cast<std::chrono::microseconds>(IN_rtt);
+    if(!mSmoothedRtt.has_value())
+    {
+        mSmoothedRtt = rtt;
+        mRttVariation = rtt / 2;
+    }
+    else
+    {
+        const std::chrono::microseconds deviation = mSmoothedRtt.value() > rtt ? mSmoothedRtt.value() - rtt : rtt - mSmoothedRtt.value();
+        mRttVariation = (3 * mRttVariation + deviation) / 4;
+        mSmoothedRtt = (7 * mSmoothedRtt.value() + rtt) / 8;
+    }
+
+    const std::chrono::microseconds min_timeout = std::min<std::chrono::microseconds>(std::chrono::milliseconds(MIN_RETRANSMISSION_TIME_MS), mMaxTimeout);
+    mTimeout = std::clamp<std::chrono::microseconds>(mSmoothedRtt.value() + 4 * mRttVariation, min_timeout, mMaxTimeout);
+}
+
+void TftpRttEstimator::onTimeout()
+{
+    mTimeout = std::min(2 * mTimeout, mMaxTimeout);
+}
+
+std::chrono::milliseconds TftpRttEstimator::getTimeout() const
+{
+    return std::chrono::ceil<std::chrono::milliseconds>(mTimeout);
+}
+
+bool TftpRttEstimator::isAtMaxTimeout() const
+{
+    return mTimeout >= mMaxTimeout;
+}
@@ -0,0 +1,31 @@
+#ifndef TFTPRTTESTIMATOR_H
+#define TFTPRTTESTIMATOR_H
+
+#include <chrono>
+#include <optional>
+
+/*
+ * Adapts the retransmission timeout of one transfer to the measured round trip times (SRTT and RTTVAR as in rfc6298), with exponential backoff on timeouts.
+ * Following Karn's rule, only round trips of packets that were not retransmitted may be supplied as samples.
+ * The configured timeout of the transfer is used until the first sample arrives, and is the upper bound of the timeout.
+ * */
+class TftpRttEstimator
+{
+public:
+    explicit TftpRttEstimator(std::chrono::milliseconds IN_maxtimeout);
+
+    void addSample(std::chrono::steady_clock::duration IN_rtt);
+    void onTimeout();
+
+    [[nodiscard]] std::chrono::milliseconds getTimeout() const;
+    //True if the current timeout is the configured timeout, i.e. there is no shorter estimate or it was backed off completely
+    [[nodiscard]] bool isAtMaxTimeout() const;
+
+private:
+    std::chrono::microseconds mMaxTimeout;
+    std::chrono::microseconds mTimeout;
+    std::optional<std::chrono::microseconds> mSmoothedRtt;
+    std::chrono::microseconds mRttVariation{0};
+};
+
+#endif // TFTPRTTESTIMATOR_H
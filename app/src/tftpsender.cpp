@@ -1,6 +1,8 @@
 #include "tftpsender.h"
 #include "tftphelpdefs.h"
 #include "tftpmessages.h"
+#include <algorithm>
+#include <cerrno>
 #include <iostream>
 
 Tftpsender::Tftpsender(boost::asio::ip::udp::socket &&INsocket,
@@ -11,11 +13,12 @@ Tftpsender::Tftpsender(boost::asio::ip::udp::socket &&INsocket,
                        int IN_firstAck,
                        std::function<void(std::shared_ptr<Tftpsender>,TftpUserFacingErrorCode)> INOperationDoneCallback,
                        std::size_t INblocksize,
-                       uint8_t IN_timeout_seconds)
-    :Tftpsender(std::move(INsocket), inputstream, INmode, IN_firstAck, INOperationDoneCallback, INblocksize, IN_timeout_seconds)
+                       std::chrono::milliseconds IN_timeout,
+                       uint16_t IN_windowsize,
+                       uint16_t IN_rollover,
+                       std::shared_ptr<TftpTimingWheel> IN_timingwheel)
+    :Tftpsender(std::move(INsocket), makeStreamBlockSource(inputstream, INblocksize, IN_windowsize), INmode, INremoteaddress, port, IN_firstAck, INOperationDoneCallback, INblocksize, IN_timeout, IN_windowsize, IN_rollover, IN_timingwheel)
 {
-    mLastReceivedReceiverEndpoint = boost::asio::ip::udp::endpoint(INremoteaddress, port);
-    onConnect();
 }
 
 Tftpsender::Tftpsender(boost::asio::ip::udp::socket &&IN_socket,
@@ -23,16 +26,54 @@ Tftpsender::Tftpsender(boost::asio::ip::udp::socket &&IN_socket,
                        TftpMode IN_mode,
                        int IN_firstAck, std::function<void(std::shared_ptr<Tftpsender>,TftpUserFacingErrorCode)> IN_OperationDoneCallback,
                        std::size_t IN_blocksize,
-                       uint8_t IN_timeout_seconds)
+                       std::chrono::milliseconds IN_timeout,
+                       uint16_t IN_windowsize,
+                       uint16_t IN_rollover,
+                       std::shared_ptr<TftpTimingWheel> IN_timingwheel)
+    :Tftpsender(std::move(IN_socket), makeStreamBlockSource(inputstream, IN_blocksize, IN_windowsize), IN_mode, IN_firstAck, IN_OperationDoneCallback, IN_blocksize, IN_timeout, IN_windowsize, IN_rollover, IN_timingwheel)
+{
+}
+
+Tftpsender::Tftpsender(boost::asio::ip::udp::socket &&INsocket,
+                       std::shared_ptr<ITftpBlockSource> IN_blocksource,
+                       TftpMode INmode,
+                       const boost::asio::ip::address &INremoteaddress,
+                       uint16_t port,
+                       int IN_firstAck,
+                       std::function<void(std::shared_ptr<Tftpsender>,TftpUserFacingErrorCode)> INOperationDoneCallback,
+                       std::size_t INblocksize,
+                       std::chrono::milliseconds IN_timeout,
+                       uint16_t IN_windowsize,
+                       uint16_t IN_rollover,
+                       std::shared_ptr<TftpTimingWheel> IN_timingwheel)
+    :Tftpsender(std::move(INsocket), IN_blocksource, INmode, IN_firstAck, INOperationDoneCallback, INblocksize, IN_timeout, IN_windowsize, IN_rollover, IN_timingwheel)
+{
+    mLastReceivedReceiverEndpoint = boost::asio::ip::udp::endpoint(INremoteaddress, port);
+    onConnect();
+}
+
+Tftpsender::Tftpsender(boost::asio::ip::udp::socket &&IN_socket,
+                       std::shared_ptr<ITftpBlockSource> IN_blocksource,
+                       [[maybe_unused]] TftpMode IN_mode, //only octet mode is supported so far
+                       int IN_firstAck, std::function<void(std::shared_ptr<Tftpsender>,TftpUserFacingErrorCode)> IN_OperationDoneCallback,
+                       std::size_t IN_blocksize,
+                       std::chrono::milliseconds IN_timeout,
+                       uint16_t IN_windowsize,
+                       uint16_t IN_rollover,
+                       std::shared_ptr<TftpTimingWheel> IN_timingwheel)
     :blocksize(IN_blocksize),
     remoteConnSocket(std::move(IN_socket)),
-    lastsentdata(blocksize),
-    lastsentdatacount(IN_firstAck),
+    windowbegin(IN_firstAck),
+    windowsize(IN_windowsize),
+    rollover(IN_rollover),
+    blocksource(IN_blocksource),
+    windowheaders(std::max<uint16_t>(IN_windowsize, 1)),
+    windowiovecs(windowheaders.size()),
+    windowdatagrams(windowheaders.size()),
     ackbuffer(OPCODELENGTH + BLOCKNRLENGTH),
-    readTimeoutTimer(remoteConnSocket.get_executor()),
-    timeout_seconds(IN_timeout_seconds),
-    mOperationDoneCallback(IN_OperationDoneCallback),
-    input(inputstream)
+    readTimeoutTimer(remoteConnSocket.get_executor(), IN_timingwheel),
+    rtt(IN_timeout),
+    mOperationDoneCallback(IN_OperationDoneCallback)
 {
     if(!remoteConnSocket.is_open())
     {
@@ -40,19 +81,29 @@ Tftpsender::Tftpsender(boost::asio::ip::udp::socket &&IN_socket,
     }
 }
 
+uint32_t Tftpsender::getChecksum() const
+{
+    return checksum.value();
+}
+
+uint64_t Tftpsender::getSuppressedDuplicateAcks() const
+{
+    return suppressedduplicateacks;
+}
+
 void Tftpsender::start()
 {
-    if(!input || !*input)
+    if(!blocksource)
     {
         sendErrorMsg(static_cast<error_t>(TftpErrorCode::ERR_FILE_NOT_FOUND), "Requested file not found or insufficient permissions", mReceiverEndpoint);
         endOperation(TftpUserFacingErrorCode::ERR_INPUT_FILE_OPEN);
     }
     else
     {
-        //Server case: If remote connection is established, start by sending first block, subsequently expecting an ACK for block 1
-        if(lastsentdatacount == 1)
+        //Server case: If remote connection is established, start by sending first window, subsequently expecting an ACK for its last block
+        if(windowbegin == 1)
         {
-            sendNextBlock();
+            sendWindow();
         }
         //Client case: We need to establish the connection first
         else
@@ -62,40 +113,195 @@ void Tftpsender::start()
     }
 }
 
-void Tftpsender::sendNextBlock()
+/*!
+ * \brief Sends all blocks of the current window (rfc7440), starting at the first block that has not been acknowledged yet.
+ * A window of size 1 is the lock-step behaviour of rfc1350. Resends also always start at windowbegin (go-back-N).
+ * The blocks are first queued and then handed to the socket as one batch, so a whole window costs one system call instead of one per block.
+ * If the block source still has to read blocks of the window from disk, sending is resumed by the block source once they were read.
+ */
+void Tftpsender::sendWindow()
+{
+    //Blocks that are not in memory yet are read without blocking this thread; the window is sent once they are there
+    auto self = shared_from_this();
+    if(!blocksource->prepareBlocks(windowbegin - 1, windowbegin - 1 + std::max<uint16_t>(windowsize, 1), remoteConnSocket.get_executor(),
+                                   [self] ()
+                                   {
+                                       if(!self->operationEnded)
+                                       {
+                                           self->sendWindow();
+                                       }
+                                   }))
+    {
+        return;
+    }
+
+    windowretransmitted = windowbegin <= lastsentdatacount;
+    windowsenttime = std::chrono::steady_clock::now();
+    queueddatagrams = 0;
+    sentdatagrams = 0;
+    nextblocktoqueue = windowbegin;
+    windowqueued = false;
+    continueWindow();
+}
+
+/*!
+ * \brief Queues the blocks of the window and sends them. The block source may not be able to hold a whole large window at once,
+ * so only as many blocks are queued as it can hold; the next ones are queued after those were sent.
+ */
+void Tftpsender::continueWindow()
 {
-    input->seekg((lastsentdatacount - 1) * blocksize);
-    if(input && *input)
+    while(true)
     {
-        lastsentdata.assign(lastsentdata.size(), 0);
-        input->read(lastsentdata.data(), blocksize);
+        if(!queueBlocks() || !flushWindow())
+        {
+            return;
+        }
+        if(windowqueued)
+        {
+            onWindowSent();
+            return;
+        }
     }
-    else
+}
+
+/*!
+ * \brief Queues the next blocks of the window, at most as many as the block source can hold at the same time
+ * \return false if the input could not be read (the operation is ended in that case)
+ */
+bool Tftpsender::queueBlocks()
+{
+    const std::size_t maxblocks = blocksource->maxHeldBlocks();
+    for(std::size_t queuedblocks = 0; queuedblocks < maxblocks && !windowqueued; ++queuedblocks, ++nextblocktoqueue)
+    {
+        const block_count_t blocknr = nextblocktoqueue;
+        const std::optional<boost::asio::const_buffer> payload = readBlock(blocknr);
+        if(!payload.has_value())
+        {
+            return false;
+        }
+
+        const bool lastBlockOfFile = payload->size() < blocksize;
+        queueBlock(blocknr, payload.value());
+
+        if(blocknr > lastsentdatacount)
+        {
+            checksum.update(payload->data(), payload->size());
+            lastsentdatacount = blocknr;
+        }
+        if(lastBlockOfFile)
+        {
+            sendingdone = true;
+        }
+        windowqueued = lastBlockOfFile || blocknr - windowbegin + 1 >= windowsize;
+    }
+    return true;
+}
+
+/*!
+ * \brief Gets the payload of the given block from the block source
+ * \return payload of the block, or nothing if the input could not be read (the operation is ended in that case)
+ */
+std::optional<boost::asio::const_buffer> Tftpsender::readBlock(block_count_t blocknr)
+{
+    std::optional<boost::asio::const_buffer> payload = blocksource->getBlock(blocknr - 1);
+    if(!payload.has_value())
     {
         sendErrorMsg(static_cast<error_t>(TftpErrorCode::ERR_ACCESS_VIOLATION), "Error reading from requested file. Might not exist (anymore) or insufficient permissions.", mReceiverEndpoint);
         endOperation(TftpUserFacingErrorCode::ERR_INPUT_FILE_OPEN);
     }
-    auto readbytes = input->gcount();
-    DataMessage msg_to_send(readbytes);
-    //Use only the part of lastsentdata that was actually just read from file: (important for last block)
-    msg_to_send.setData(std::vector<char>(lastsentdata.begin(), lastsentdata.begin()+readbytes));
-    msg_to_send.setBlockNr(lastsentdatacount);
-    std::shared_ptr<std::string> str_to_send = std::make_shared<std::string>(msg_to_send.encode());
+    return payload;
+}
 
-    auto self = shared_from_this();
-    remoteConnSocket.async_send_to(boost::asio::buffer(*str_to_send, str_to_send->size()), mReceiverEndpoint, [self, str_to_send](boost::system::error_code err, std::size_t sentbytes)
-                                   {
-                                       if(!err && sentbytes != 0)
-                                       {
-                                           self->readTimeoutTimer.expires_from_now(boost::posix_time::seconds(self->timeout_seconds));
-                                           self->readTimeoutTimer.async_wait(std::bind(&Tftpsender::handleReadTimeout, self, boost::asio::placeholders::error));
-                                           self->startNextReceive();
-                                       }
-                                   });
-    if(readbytes < blocksize)
+/*!
+ * \brief Queues the given block as header plus the payload buffer of the block source, so the payload is not copied before it reaches the socket.
+ * The header and the datagram description live in the window slot of the block, so queueing a block does not allocate.
+ */
+void Tftpsender::queueBlock(block_count_t blocknr, boost::asio::const_buffer payload)
+{
+    DataMessage msg_to_send(0);
+    msg_to_send.setBlockNr(wireBlockNr(blocknr, rollover));
+    //A block always uses the same header slot, and a slot is only reused for another block after the whole window was acknowledged
+    std::array<unsigned char, CONTROLBYTES> &header = windowheaders[blocknr % windowheaders.size()];
+    header = msg_to_send.encodeHeader();
+
+    std::array<iovec, 2> &iovecs = windowiovecs[queueddatagrams];
+    iovecs[0].iov_base = header.data();
+    iovecs[0].iov_len = header.size();
+    iovecs[1].iov_base = const_cast<void*>(payload.data());
+    iovecs[1].iov_len = payload.size();
+
+    mmsghdr &datagram = windowdatagrams[queueddatagrams];
+    datagram = mmsghdr{};
+    datagram.msg_hdr.msg_name = mReceiverEndpoint.data();
+    datagram.msg_hdr.msg_namelen = mReceiverEndpoint.size();
+    datagram.msg_hdr.msg_iov = iovecs.data();
+    datagram.msg_hdr.msg_iovlen = iovecs.size();
+    ++queueddatagrams;
+}
+
+/*!
+ * \brief Hands all queued datagrams that were not sent yet to the socket with one sendmmsg call.
+ * If the socket buffer is full, only a part of the datagrams is sent; the rest is sent as soon as the socket is writable again, and the window is continued after that.
+ * \return true if all queued datagrams were sent
+ */
+bool Tftpsender::flushWindow()
+{
+    while(sentdatagrams < queueddatagrams)
     {
-        sendingdone = true;
+        const int result = sendmmsg(remoteConnSocket.native_handle(), &windowdatagrams[sentdatagrams], queueddatagrams - sentdatagrams, MSG_DONTWAIT);
+        if(result < 0)
+        {
+            if(errno == EINTR)
+            {
+                continue;
+            }
+            if(errno == EAGAIN || errno == EWOULDBLOCK)
+            {
+                auto self = shared_from_this();
+                remoteConnSocket.async_wait(boost::asio::ip::udp::socket::wait_write, [self](boost::system::error_code err)
+                                            {
+                                                if(!err)
+                                                {
+                                                    if(self->flushWindow())
+                                                    {
+                                                        self->continueWindow();
+                                                    }
+                                                }
+                                                //No timer is armed while the window is sent, so nothing else would end the transfer
+                                                else if(err != boost::asio::error::operation_aborted)
+                                                {
+                                                    self->endOperation(err);
+                                                }
+                                            });
+                return false;
+            }
+            endOperation(boost::system::error_code(errno, boost::system::system_category()));
+            return false;
+        }
+        sentdatagrams += result;
     }
+    return true;
+}
+
+void Tftpsender::onWindowSent()
+{
+    acktimeout = std::chrono::steady_clock::now() + rtt.getTimeout();
+    readTimeoutTimer.expiresAfter(rtt.getTimeout(), std::bind(&Tftpsender::handleReadTimeout, shared_from_this(), boost::asio::placeholders::error));
+    startNextReceive();
+}
+
+/*!
+ * \brief Keeps waiting for the ACK of the window after a datagram that is not answered with a resend. The timeout keeps its original deadline.
+ * Before the first ACK of a client transfer, nothing was sent yet, so there is no timeout either.
+ */
+void Tftpsender::continueWaitingForAck()
+{
+    if(isConnected)
+    {
+        const auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(acktimeout - std::chrono::steady_clock::now());
+        readTimeoutTimer.expiresAfter(std::max(remaining, std::chrono::milliseconds(0)), std::bind(&Tftpsender::handleReadTimeout, shared_from_this(), boost::asio::placeholders::error));
+    }
+    startNextReceive();
 }
 
 void Tftpsender::checkAckForLastBlock(boost::system::error_code err, std::size_t sentbytes)
@@ -107,7 +313,7 @@ void Tftpsender::checkAckForLastBlock(boost::system::error_code err, std::size_t
 
         AckMessage received_msg;
         //Can only not be valid if opcode is wrong
-        const bool valid_msg = received_msg.decode(std::string(ackbuffer.begin(), ackbuffer.end()));
+        const bool valid_msg = received_msg.decode(boost::asio::buffer(ackbuffer, sentbytes));
 
         //handle error code: include timeout for read, and differentiate between timeout error (then treat as resend) and actual errors (abort sending)
         if(!valid_msg)
@@ -118,14 +324,33 @@ void Tftpsender::checkAckForLastBlock(boost::system::error_code err, std::size_t
         }
         else
         {
-            const uint16_t ack_block = received_msg.getBlockNr();
-            if(ack_block < lastsentdatacount)
+            //An ACK can only be for a block of the current window or shortly before it, so its block number is unwrapped around the window
+            const block_count_t ack_block = unwrapBlockNr(received_msg.getBlockNr(), windowbegin, rollover);
+            if(ack_block > lastsentdatacount)
             {
-                //Resends the current block
-                sendNextBlock();
+                sendErrorMsg(4, "ACK for package that was not yet sent: expected " + std::to_string(lastsentdatacount) + ", got " + std::to_string(ack_block), mReceiverEndpoint);
+                //TODO: what errorcode to set?
+                endOperation();
             }
-            //Received the ack we were waiting for
-            else if(ack_block == lastsentdatacount)
+            //Sorcerer's Apprentice: an ACK that acknowledges nothing new only means that the receiver saw a block twice, or that it was delayed.
+            //Answering each of them would send every following block twice, so resends are left to the timeout.
+            //rfc7440: only the receiver's report of a gap in the window (an ACK for the block before it) resends the window early, once per progress
+            else if(ack_block < windowbegin)
+            {
+                if(ack_block + 1 == windowbegin && windowsize > 1 && !resentsinceprogress)
+                {
+                    resentsinceprogress = true;
+                    sendWindow();
+                }
+                else
+                {
+                    suppressedduplicateacks++;
+                    continueWaitingForAck();
+                }
+            }
+            //ACK inside the current window: everything up to and including ack_block has arrived.
+            //If it is not the last block that was sent, the receiver missed a block and the next window starts right after ack_block
+            else
             {
                 //If this is the first message from this peer, set it as correct remote host for this transfer
                 if(!isConnected)
@@ -133,39 +358,44 @@ void Tftpsender::checkAckForLastBlock(boost::system::error_code err, std::size_t
                     onConnect();
                 }
 
-
-                lastsentdatacount++;
+                //ACK 0 answers an OACK or the WRQ, no window was timed for it yet
+                if(!windowretransmitted && lastsentdatacount > 0)
+                {
+                    rtt.addSample(std::chrono::steady_clock::now() - windowsenttime);
+                }
+                windowbegin = ack_block + 1;
+                blocksource->releaseBlocksBefore(windowbegin - 1);
                 timeoutcount = 0;
+                resentsinceprogress = false;
 
                 //Received ACK for last block:
-                if(sendingdone)
+                if(sendingdone && ack_block == lastsentdatacount)
                 {
                     endOperation();
                 }
                 else
                 {
-                    sendNextBlock();
+                    sendWindow();
                 }
             }
-            else if(ack_block > lastsentdatacount)
-            {
-                sendErrorMsg(4, "ACK for package that was not yet sent: expected " + std::to_string(lastsentdatacount) + ", got " + std::to_string(ack_block), mReceiverEndpoint);
-                //TODO: what errorcode to set?
-                endOperation();
-            }
         }
     }
     else if(wrongRemoteHost)
     {
         //After sending error message, keep going with a normal receive
         sendErrorMsg(static_cast<error_t>(TftpErrorCode::ERR_UNKNOWN_TR_ID), "Remote host is not the partner of the transfer on this port", mLastReceivedReceiverEndpoint);
-        //For reasons of laziness, just re-send the previous block
-        sendNextBlock();
+        continueWaitingForAck();
     }
     //Read operation momentarily cancelled by timer
-    else if(err == boost::asio::error::operation_aborted || sentbytes != OPCODELENGTH + BLOCKNRLENGTH)
+    else if(err == boost::asio::error::operation_aborted)
     {
-        sendNextBlock();
+        resentsinceprogress = true;
+        sendWindow();
+    }
+    //Not an ACK at all, it does not make the window be resent either
+    else if(sentbytes != OPCODELENGTH + BLOCKNRLENGTH)
+    {
+        continueWaitingForAck();
     }
     else
     {
@@ -192,7 +422,12 @@ void Tftpsender::handleReadTimeout(boost::system::error_code err)
     if(err != boost::asio::error::operation_aborted)
     {
         remoteConnSocket.cancel();
-        timeoutcount++;
+        //Only waits for the full configured timeout count towards closing the connection, shorter waits from the round trip estimate are backed off first
+        if(rtt.isAtMaxTimeout())
+        {
+            timeoutcount++;
+        }
+        rtt.onTimeout();
         if(timeoutcount <= RETRANSMISSIONS_UNTIL_TIMEOUT)
         {
             //sendNextAck(); //is already done in checkReceivedBlock in case of timer cancel
@@ -3,8 +3,16 @@
 
 #include <string>
 #include <memory>
+#include <array>
+#include <vector>
 #include <boost/asio.hpp>
+#include <sys/socket.h>
+#include <sys/uio.h>
 #include "tftphelpdefs.h"
+#include "tftpblocksource.h"
+#include "tftpchecksum.h"
+#include "tftprttestimator.h"
+#include "tftptimingwheel.h"
 
 //TODO: instead of adding options like blocksize individually, use one TransactionOptionValues object
 
@@ -22,7 +30,10 @@ public:
                int IN_firstAck,
                std::function<void(std::shared_ptr<Tftpsender>, TftpUserFacingErrorCode)> IN_operationDoneCallback = [](std::shared_ptr<Tftpsender>, TftpUserFacingErrorCode){},
                std::size_t IN_blocksize = DEFAULT_BLOCKSIZE,
-               uint8_t IN_timeout_seconds = RETRANSMISSION_TIME);
+               std::chrono::milliseconds IN_timeout = std::chrono::seconds(RETRANSMISSION_TIME),
+               uint16_t IN_windowsize = DEFAULT_WINDOWSIZE,
+               uint16_t IN_rollover = DEFAULT_ROLLOVER,
+               std::shared_ptr<TftpTimingWheel> IN_timingwheel = {});
 
     //Ctor if remote endpoint is not known yet (for client use, wait for ACK 0)
     Tftpsender(boost::asio::ip::udp::socket &&IN_socket,
@@ -30,11 +41,50 @@ public:
                int IN_firstAck,
                std::function<void(std::shared_ptr<Tftpsender>, TftpUserFacingErrorCode)> IN_operationDoneCallback = [](std::shared_ptr<Tftpsender>, TftpUserFacingErrorCode){},
                std::size_t IN_blocksize = DEFAULT_BLOCKSIZE,
-               uint8_t IN_timeout_seconds = RETRANSMISSION_TIME);
+               std::chrono::milliseconds IN_timeout = std::chrono::seconds(RETRANSMISSION_TIME),
+               uint16_t IN_windowsize = DEFAULT_WINDOWSIZE,
+               uint16_t IN_rollover = DEFAULT_ROLLOVER,
+               std::shared_ptr<TftpTimingWheel> IN_timingwheel = {});
+
+    //Ctor if remote endpoint is known, with the payload supplied by any block source (e.g. the server block cache)
+    Tftpsender(boost::asio::ip::udp::socket &&IN_socket,
+               std::shared_ptr<ITftpBlockSource> IN_blocksource, TftpMode IN_mode,
+               const boost::asio::ip::address &IN_remoteaddress,
+               uint16_t IN_port,
+               int IN_firstAck,
+               std::function<void(std::shared_ptr<Tftpsender>, TftpUserFacingErrorCode)> IN_operationDoneCallback = [](std::shared_ptr<Tftpsender>, TftpUserFacingErrorCode){},
+               std::size_t IN_blocksize = DEFAULT_BLOCKSIZE,
+               std::chrono::milliseconds IN_timeout = std::chrono::seconds(RETRANSMISSION_TIME),
+               uint16_t IN_windowsize = DEFAULT_WINDOWSIZE,
+               uint16_t IN_rollover = DEFAULT_ROLLOVER,
+               std::shared_ptr<TftpTimingWheel> IN_timingwheel = {});
+
+    //Ctor if remote endpoint is not known yet, with the payload supplied by any block source
+    Tftpsender(boost::asio::ip::udp::socket &&IN_socket,
+               std::shared_ptr<ITftpBlockSource> IN_blocksource, TftpMode IN_mode,
+               int IN_firstAck,
+               std::function<void(std::shared_ptr<Tftpsender>, TftpUserFacingErrorCode)> IN_operationDoneCallback = [](std::shared_ptr<Tftpsender>, TftpUserFacingErrorCode){},
+               std::size_t IN_blocksize = DEFAULT_BLOCKSIZE,
+               std::chrono::milliseconds IN_timeout = std::chrono::seconds(RETRANSMISSION_TIME),
+               uint16_t IN_windowsize = DEFAULT_WINDOWSIZE,
+               uint16_t IN_rollover = DEFAULT_ROLLOVER,
+               std::shared_ptr<TftpTimingWheel> IN_timingwheel = {});
 
     void start();
+
+    //CRC32C of all payload sent so far, i.e. of the whole file once the transfer finished
+    [[nodiscard]] uint32_t getChecksum() const;
+    //ACKs that did not acknowledge anything new and were not answered with a resend
+    [[nodiscard]] uint64_t getSuppressedDuplicateAcks() const;
 private:
-    void sendNextBlock();
+    void sendWindow();
+    void continueWindow();
+    bool queueBlocks();
+    std::optional<boost::asio::const_buffer> readBlock(block_count_t blocknr);
+    void queueBlock(block_count_t blocknr, boost::asio::const_buffer payload);
+    bool flushWindow();
+    void onWindowSent();
+    void continueWaitingForAck();
     void checkAckForLastBlock(boost::system::error_code err, std::size_t sentbytes);
     void sendErrorMsg(error_t errorcode, const std::string &msg, boost::asio::ip::udp::endpoint& endpoint_to_send);
     void handleReadTimeout(boost::system::error_code err);
@@ -51,15 +101,41 @@ private:
     std::string filename = "";
     std::size_t blocksize{0};
     boost::asio::ip::udp::socket remoteConnSocket;
-    std::vector<char> lastsentdata{};
-    uint16_t lastsentdatacount{1};
+    //Highest block number that was sent so far. Block numbers are counted without rollover, so transfers may have more than 65535 blocks
+    block_count_t lastsentdatacount{0};
+    //rfc7440: first block of the current window, i.e. the first block that has not been acknowledged yet
+    block_count_t windowbegin{1};
+    uint16_t windowsize{DEFAULT_WINDOWSIZE};
+    uint16_t rollover{DEFAULT_ROLLOVER};
+    //Holds the current window until it is acknowledged, or as much of it as its memory allows; DATA payloads are sent directly out of it
+    std::shared_ptr<ITftpBlockSource> blocksource;
+    //DATA headers of the blocks in flight, one slot per block of a window, so no header is allocated per sent block
+    std::vector<std::array<unsigned char, CONTROLBYTES>> windowheaders;
+    //Datagrams of the current window, handed to the socket together with sendmmsg. One slot per block of a window, like the headers
+    std::vector<std::array<iovec, 2>> windowiovecs;
+    std::vector<mmsghdr> windowdatagrams;
+    std::size_t queueddatagrams{0};
+    std::size_t sentdatagrams{0};
+    //Next block of the current window that is not queued yet, and whether its last block was queued
+    block_count_t nextblocktoqueue{1};
+    bool windowqueued{false};
     std::vector<char> ackbuffer{};
+    //Updated with every block when it is sent for the first time, so resends do not count twice
+    TftpChecksum checksum;
 
     bool sendingdone{false};
 
-    boost::asio::deadline_timer readTimeoutTimer;
+    TftpTransferTimer readTimeoutTimer;
     uint16_t timeoutcount{0};
-    uint8_t timeout_seconds = RETRANSMISSION_TIME;
+    TftpRttEstimator rtt;
+    //Karn's rule: the round trip time is only measured for windows that were sent for the first time
+    std::chrono::steady_clock::time_point windowsenttime;
+    bool windowretransmitted{false};
+    //Sorcerer's Apprentice: duplicate ACKs do not restart the timeout, and a window is resent because of one at most once per progress,
+    //so a delayed block cannot double all following traffic
+    std::chrono::steady_clock::time_point acktimeout;
+    bool resentsinceprogress{false};
+    uint64_t suppressedduplicateacks{0};
 
     std::function<void(std::shared_ptr<Tftpsender>, TftpUserFacingErrorCode)> mOperationDoneCallback;
 
@@ -67,8 +143,6 @@ private:
     boost::asio::ip::udp::endpoint mLastReceivedReceiverEndpoint;
     bool isConnected = false;
     bool operationEnded = false;
-
-    std::shared_ptr<std::istream> input;
 };
 
 #endif // TFTPSENDER_H
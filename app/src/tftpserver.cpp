@@ -5,6 +5,8 @@
 #include <iostream>
 #include <fstream>
 #include <filesystem>
+#include <algorithm>
+#include <thread>
 
 /*
  * General behavior:
@@ -26,12 +28,21 @@
  * */
 
 //At creation of server, start listening on Port 69
-TftpServer::TftpServer(std::string INrootfolder, boost::asio::io_context &ctx, uint16_t port)
+TftpServer::TftpServer(std::string INrootfolder, boost::asio::io_context &ctx, uint16_t port, std::size_t IN_cachebytes, unsigned int IN_threads, TftpFileIoBackend IN_fileio, uint64_t IN_directiothreshold)
     :   mIoContext(ctx),
+    mThreadCount(std::max(1u, IN_threads)),
     mStrand(boost::asio::make_strand(mIoContext)),
     mAccSocket(mStrand, boost::asio::ip::udp::endpoint(boost::asio::ip::udp::v4(), port)),
-    rootfolder(INrootfolder)
+    rootfolder(INrootfolder),
+    mFileIo(makeFileIo(IN_fileio)),
+    mDirectIoThreshold(IN_directiothreshold),
+    mTimingWheel(std::make_shared<TftpTimingWheel>(mStrand))
 {
+    if(IN_cachebytes > 0)
+    {
+        mBlockCache = std::make_shared<TftpBlockCache>(IN_cachebytes);
+    }
+
     buffer.fill(0);
     boost::asio::socket_base::reuse_address option(true);
     mAccSocket.set_option(option);
@@ -41,11 +52,21 @@ TftpServer::TftpServer(std::string INrootfolder, boost::asio::io_context &ctx, u
 }
 
 /*!
- * \brief Runs the IOContext queue until an error occurs or a termination signal arrives. Blocks until then.
+ * \brief Runs the IOContext queue on the configured amount of threads until an error occurs or a termination signal arrives. Blocks until then.
  */
 void TftpServer::run()
 {
+    std::vector<std::thread> threads;
+    threads.reserve(mThreadCount - 1);
+    for(unsigned int i = 1; i < mThreadCount; ++i)
+    {
+        threads.emplace_back([this] () { mIoContext.run(); });
+    }
     mIoContext.run();
+    for(std::thread &thread : threads)
+    {
+        thread.join();
+    }
 }
 
 void TftpServer::HandleRequest(boost::system::error_code err, std::size_t receivedbytes)
@@ -57,20 +78,21 @@ void TftpServer::HandleRequest(boost::system::error_code err, std::size_t receiv
             sendErrorMsg(TftpErrorCode::ERR_ILLEGAL_OP, "Did not receive a valid opcode");
         }
 
-        RequestMessage received_msg;
-        bool valid_request = received_msg.decode(std::string(buffer.begin(), buffer.begin() + receivedbytes));
+        //Filename and options stay in the receive buffer, which is only reused after the request is handled
+        TftpParsedRequest received_msg;
+        bool valid_request = RequestMessage::decodeInPlace(boost::asio::buffer(buffer, receivedbytes), received_msg);
 
         if(!valid_request)
         {
             sendErrorMsg(TftpErrorCode::ERR_ILLEGAL_OP, "Did not receive a valid request message. Opcode or mode were not recognized");
         }
 
-        if(received_msg.isRRQ())
+        if(received_msg.opcode == TftpOpcode::RRQ)
         {
             HandleSubRequest_RRQ(received_msg);
         }
 
-        else if(received_msg.isWRQ())
+        else if(received_msg.opcode == TftpOpcode::WRQ)
         {
             HandleSubRequest_WRQ(received_msg);
         }
@@ -87,15 +109,17 @@ void TftpServer::HandleRequest(boost::system::error_code err, std::size_t receiv
 /*!
  * \brief Handle an incoming read request on the server listen port
  */
-void TftpServer::HandleSubRequest_RRQ(const RequestMessage &request)
+void TftpServer::HandleSubRequest_RRQ(const TftpParsedRequest &request)
 {
-    std::string filename_to_read = request.getFilename();
-    filename_to_read = rootfolder + filename_to_read; //get full path
-    std::string mode = mode2str(request.getMode());
+    std::string filename_to_read = rootfolder;
+    filename_to_read += request.filename; //get full path
+    std::string mode = mode2str(request.mode);
     uint16_t remoteport = currAccEndpoint.port();
     boost::asio::ip::address remoteaddress = currAccEndpoint.address();
 
-    boost::asio::ip::udp::socket newsock(mStrand, boost::asio::ip::udp::v4());
+    boost::asio::ip::udp::socket newsock(boost::asio::make_strand(mIoContext), boost::asio::ip::udp::v4());
+    //The transfer runs on the strand of its socket, it is started there too
+    auto transferExecutor = newsock.get_executor();
 
     //handle option fields:
     //Check all options and values against list of known options
@@ -103,13 +127,15 @@ void TftpServer::HandleSubRequest_RRQ(const RequestMessage &request)
     //Then send an OPTACK (on new socket!)
     //Then after receiving OPTACK, client sends ACK 0, so we need to prepare the sender to expect an ACK 0 before sending the first data packet
 
-    std::optional<TransactionOptionValues> valuesFromClientRequest = parseOptionFields(request);
+    std::optional<TransactionOptionValues> valuesFromClientRequest = parseOptionFields(request.options);
     //if optional is not set: that means values were not valid: send error message over the socket
     //if optional is set: give it to sender
     //if wasSetByClient in transvals is set, expect ACK 0 and send OPTACK from new socket, otherwise ACK 1 and send nothing extra
     int expected_ack = 1;
     int blocksize_to_use = DEFAULT_BLOCKSIZE;
-    uint8_t timeout_to_use = RETRANSMISSION_TIME;
+    std::chrono::milliseconds timeout_to_use = std::chrono::seconds(RETRANSMISSION_TIME);
+    uint16_t windowsize_to_use = DEFAULT_WINDOWSIZE;
+    uint16_t rollover_to_use = DEFAULT_ROLLOVER;
     if(valuesFromClientRequest)
     {
         if(valuesFromClientRequest->wasSetByClient)
@@ -139,7 +165,9 @@ void TftpServer::HandleSubRequest_RRQ(const RequestMessage &request)
             newsock.send_to(boost::asio::buffer(message_to_send, message_to_send.size()), currAccEndpoint);
             expected_ack = 0;
             blocksize_to_use = valuesFromClientRequest.value().mBlocksize.value_or(DEFAULT_BLOCKSIZE);
-            timeout_to_use = valuesFromClientRequest.value().mTimeout.value_or(RETRANSMISSION_TIME);
+            timeout_to_use = valuesFromClientRequest.value().getRetransmissionTimeout();
+            windowsize_to_use = valuesFromClientRequest.value().mWindowsize.value_or(DEFAULT_WINDOWSIZE);
+            rollover_to_use = valuesFromClientRequest.value().mRollover.value_or(DEFAULT_ROLLOVER);
         }
     }
     else
@@ -149,10 +177,21 @@ void TftpServer::HandleSubRequest_RRQ(const RequestMessage &request)
         //TODO: stop processing the WRQ at this point
     }
 
-    std::shared_ptr<std::istream> ifs(new std::ifstream(filename_to_read, std::ios_base::binary));
+    //DATA payloads are sent out of the server block cache, or read through a stream if the cache is disabled or the file can not be cached.
+    //Files are not mapped, since the server can not keep them from being truncated while they are sent
+    std::shared_ptr<ITftpBlockSource> blocksource;
+    if(mBlockCache)
+    {
+        blocksource = TftpCachedBlockSource::open(mBlockCache, filename_to_read, blocksize_to_use, mFileIo);
+    }
+    if(!blocksource)
+    {
+        std::shared_ptr<std::istream> ifs(new std::ifstream(filename_to_read, std::ios_base::binary));
+        blocksource = makeStreamBlockSource(ifs, blocksize_to_use, windowsize_to_use);
+    }
 
     std::shared_ptr<Tftpsender> sender = std::make_shared<Tftpsender>(std::move(newsock),
-                                                                      ifs, str2mode(mode),
+                                                                      blocksource, str2mode(mode),
                                                                       remoteaddress,
                                                                       remoteport,
                                                                       expected_ack,
@@ -162,23 +201,28 @@ void TftpServer::HandleSubRequest_RRQ(const RequestMessage &request)
                                                                                 std::placeholders::_1,
                                                                                 std::placeholders::_2),
                                                                       blocksize_to_use,
-                                                                      timeout_to_use);
+                                                                      timeout_to_use,
+                                                                      windowsize_to_use,
+                                                                      rollover_to_use,
+                                                                      mTimingWheel);
     mSenderList.push_back(sender);
-    sender->start();
+    boost::asio::dispatch(transferExecutor, [sender] () { sender->start(); });
 }
 
 /*!
  * \brief Handle an incoming write request on the server listen port
  */
-void TftpServer::HandleSubRequest_WRQ(const RequestMessage &request)
+void TftpServer::HandleSubRequest_WRQ(const TftpParsedRequest &request)
 {
-    std::string filename_to_write = request.getFilename();
-    filename_to_write = rootfolder + filename_to_write; //get full path
-    std::string mode = mode2str(request.getMode());
+    std::string filename_to_write = rootfolder;
+    filename_to_write += request.filename; //get full path
+    std::string mode = mode2str(request.mode);
     uint16_t remoteport = currAccEndpoint.port();
     boost::asio::ip::address remoteaddress = currAccEndpoint.address();
 
-    boost::asio::ip::udp::socket newsock(mStrand, boost::asio::ip::udp::v4());
+    boost::asio::ip::udp::socket newsock(boost::asio::make_strand(mIoContext), boost::asio::ip::udp::v4());
+    //The transfer runs on the strand of its socket, it is started there too
+    auto transferExecutor = newsock.get_executor();
 
 
     //handle option fields:
@@ -187,13 +231,14 @@ void TftpServer::HandleSubRequest_WRQ(const RequestMessage &request)
     //Then send an OPTACK
     //Then after receiving OPTACK, client sends Data packet 1 with the negotiated values, so the receiver needs to have the correct settings, but otherwise same behavior as before
 
-    std::optional<TransactionOptionValues> valuesFromClientRequest = parseOptionFields(request);
+    std::optional<TransactionOptionValues> valuesFromClientRequest = parseOptionFields(request.options);
     //if optional is not set: that means values were not valid: send error message over the socket
     //if optional is set: give it to sender
     int blocksize_to_use = DEFAULT_BLOCKSIZE;
-    uint8_t timeout_to_use = RETRANSMISSION_TIME;
-
-    //TODO: include handling for tsize option
+    std::chrono::milliseconds timeout_to_use = std::chrono::seconds(RETRANSMISSION_TIME);
+    uint16_t windowsize_to_use = DEFAULT_WINDOWSIZE;
+    uint16_t rollover_to_use = DEFAULT_ROLLOVER;
+    std::shared_ptr<TftpWriteBehind> writebehind;
 
     if(valuesFromClientRequest)
     {
@@ -202,16 +247,34 @@ void TftpServer::HandleSubRequest_WRQ(const RequestMessage &request)
             OptionACKMessage msg_opt_ack_response;
             msg_opt_ack_response.setOptVals(valuesFromClientRequest->getOptionsAsMap());
 
-            if(valuesFromClientRequest->mTransferSize.has_value() && valuesFromClientRequest->mTransferSize > std::filesystem::space(rootfolder).available)
+            //The announced size is reserved on disk up front, so a file that does not fit is rejected before the transfer starts
+            if(valuesFromClientRequest->mTransferSize.has_value())
             {
-                //TODO send error code 3 and abort: we don't have enough space for the file!
+                std::error_code ec;
+                const uint64_t transfersize = valuesFromClientRequest->mTransferSize.value();
+                const bool directio = mDirectIoThreshold > 0 && transfersize >= mDirectIoThreshold;
+                writebehind = TftpWriteBehind::openPreallocated(filename_to_write, transfersize, DEFAULT_WRITE_BEHIND_BYTES, ec, mFileIo, directio);
+                if(!writebehind)
+                {
+                    if(ec == std::errc::no_space_on_device || ec == std::errc::file_too_large)
+                    {
+                        sendErrorMsg(TftpErrorCode::ERR_DISK_FULL, "Not enough space for a file of size " + std::to_string(transfersize));
+                    }
+                    else
+                    {
+                        sendErrorMsg(TftpErrorCode::ERR_ACCESS_VIOLATION, "Requested file could not be opened for output");
+                    }
+                    return;
+                }
             }
 
             //Then send an OPTACK (on new socket)
             std::string message_to_send = msg_opt_ack_response.encode();
             newsock.send_to(boost::asio::buffer(message_to_send, message_to_send.size()), currAccEndpoint);
             blocksize_to_use = valuesFromClientRequest.value().mBlocksize.value_or(DEFAULT_BLOCKSIZE);
-            timeout_to_use = valuesFromClientRequest.value().mTimeout.value_or(RETRANSMISSION_TIME);
+            timeout_to_use = valuesFromClientRequest.value().getRetransmissionTimeout();
+            windowsize_to_use = valuesFromClientRequest.value().mWindowsize.value_or(DEFAULT_WINDOWSIZE);
+            rollover_to_use = valuesFromClientRequest.value().mRollover.value_or(DEFAULT_ROLLOVER);
         }
     }
     else
@@ -222,10 +285,14 @@ void TftpServer::HandleSubRequest_WRQ(const RequestMessage &request)
         //TODO: stop processing the WRQ at this point
     }
 
-    std::shared_ptr<std::ostream> ofs(new std::ofstream(filename_to_write, std::ios_base::binary | std::ios_base::app));
+    if(!writebehind)
+    {
+        std::shared_ptr<std::ostream> ofs(new std::ofstream(filename_to_write, std::ios_base::binary | std::ios_base::app));
+        writebehind = std::make_shared<TftpWriteBehind>(ofs, DEFAULT_WRITE_BEHIND_BYTES);
+    }
 
     std::shared_ptr<TftpReceiver> receiver = std::make_shared<TftpReceiver>(std::move(newsock),
-                                                                            ofs,
+                                                                            nullptr,
                                                                             str2mode(mode),
                                                                             remoteaddress,
                                                                             remoteport,
@@ -233,9 +300,13 @@ void TftpServer::HandleSubRequest_WRQ(const RequestMessage &request)
                                                                                       (&TftpServer::handleOperationFinished),
                                                                                       this, std::placeholders::_1, std::placeholders::_2),
                                                                             blocksize_to_use,
-                                                                            timeout_to_use);
+                                                                            timeout_to_use,
+                                                                            windowsize_to_use,
+                                                                            rollover_to_use,
+                                                                            mTimingWheel,
+                                                                            writebehind);
     mReceiverList.push_back(receiver);
-    receiver->start();
+    boost::asio::dispatch(transferExecutor, [receiver] () { receiver->start(); });
 }
 
 void TftpServer::sendErrorMsg(TftpErrorCode errorcode, std::string msg)
@@ -272,19 +343,24 @@ void TftpServer::removeSenderFromList(std::shared_ptr<Tftpsender> senderToRemove
  *   For not-set-options in message, use defaults.
  *
  *   If any value is not valid for its option in the request: do not set the optional.
- * \param request
+ * \param IN_options
  * \return
  */
-std::optional<TransactionOptionValues> TftpServer::parseOptionFields(const RequestMessage &request)
+std::optional<TransactionOptionValues> TftpServer::parseOptionFields(const TftpOptionTable &IN_options)
 {
     TransactionOptionValues ret_val;
-    if(request.getOptVals().empty())
+    if(IN_options.empty())
     {
         ret_val.wasSetByClient = false;
         return ret_val;
     }
-    if(ret_val.setOptionsFromMap(request.getOptVals()))
+    if(ret_val.setOptionsFromTable(IN_options))
     {
+        //rfc7440 lets the server answer with a smaller window than requested
+        if(ret_val.mWindowsize.has_value() && ret_val.mWindowsize.value() > MAX_WINDOWSIZE)
+        {
+            ret_val.mWindowsize = MAX_WINDOWSIZE;
+        }
         ret_val.wasSetByClient = true;
         return ret_val;
     }
@@ -293,29 +369,42 @@ std::optional<TransactionOptionValues> TftpServer::parseOptionFields(const Reque
     return {};
 }
 
+/*!
+ * \brief Called on the strand of the finished sender, the bookkeeping is moved over to the strand of the server
+ */
 void TftpServer::handleOperationFinished(std::shared_ptr<Tftpsender> finishedSender, TftpUserFacingErrorCode err)
 {
-    if(err == TftpUserFacingErrorCode::ERR_NOERR)
-    {
-        std::cout << "Finished sending file"; //TODO what file?
-    }
-    else
-    {
-        std::cout << "Error while sending file"; //TODO: more info
-    }
-    removeSenderFromList(finishedSender);
+    boost::asio::post(mStrand, [this, finishedSender, err] ()
+                      {
+                          if(err == TftpUserFacingErrorCode::ERR_NOERR)
+                          {
+                              std::cout << "Finished sending file, crc32c " << std::hex << finishedSender->getChecksum() << std::dec
+                                        << ", " << finishedSender->getSuppressedDuplicateAcks() << " duplicate ACKs ignored\n"; //TODO what file?
+                          }
+                          else
+                          {
+                              std::cout << "Error while sending file"; //TODO: more info
+                          }
+                          removeSenderFromList(finishedSender);
+                      });
 }
+/*!
+ * \brief Called on the strand of the finished receiver, the bookkeeping is moved over to the strand of the server
+ */
 void TftpServer::handleOperationFinished(std::shared_ptr<TftpReceiver> finishedReceiver, TftpUserFacingErrorCode err)
 {
-    if(err == TftpUserFacingErrorCode::ERR_NOERR)
-    {
-        std::cout << "Finished receiving file"; //TODO what file?
-    }
-    else
-    {
-        std::cout << "Error while receiving file"; //TODO: more info
-    }
-    removeReceiverFromList(finishedReceiver);
-    //TODO: remove file if error condition
+    boost::asio::post(mStrand, [this, finishedReceiver, err] ()
+                      {
+                          if(err == TftpUserFacingErrorCode::ERR_NOERR)
+                          {
+                              std::cout << "Finished receiving file, crc32c " << std::hex << finishedReceiver->getChecksum() << std::dec << "\n"; //TODO what file?
+                          }
+                          else
+                          {
+                              std::cout << "Error while receiving file"; //TODO: more info
+                          }
+                          removeReceiverFromList(finishedReceiver);
+                          //TODO: remove file if error condition
+                      });
 }
 
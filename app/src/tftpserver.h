@@ -7,11 +7,20 @@
 #include "tftpmessages.h"
 #include "tftpsender.h"
 #include "tftpreceiver.h"
+#include "tftpblockcache.h"
+#include "tftpfileio.h"
+#include "tftptimingwheel.h"
 
 class TftpServer
 {
 public:
-    TftpServer(std::string rootfolder, boost::asio::io_context &ctx, uint16_t port = SERVER_LISTEN_PORT);
+    //A cache size of 0 disables the block cache, files are then read through a stream for every transfer
+    //Every transfer runs on a strand of its own, so with more than one thread, transfers are handled in parallel
+    //The file I/O backend reads uncached chunks and writes preallocated uploads; io_uring falls back to threads if the kernel does not support it
+    //Uploads that announce at least IN_directiothreshold bytes (tsize) are written with direct I/O, 0 disables that
+    TftpServer(std::string rootfolder, boost::asio::io_context &ctx, uint16_t port = SERVER_LISTEN_PORT, std::size_t IN_cachebytes = DEFAULT_BLOCK_CACHE_BYTES,
+               unsigned int IN_threads = DEFAULT_SERVER_THREADS, TftpFileIoBackend IN_fileio = TftpFileIoBackend::THREADS,
+               uint64_t IN_directiothreshold = DEFAULT_DIRECT_IO_THRESHOLD_BYTES);
 
     void run();
 
@@ -19,8 +28,8 @@ public:
 
 private:
     void HandleRequest(boost::system::error_code err, std::size_t receivedbytes);
-    void HandleSubRequest_RRQ(const RequestMessage &request);
-    void HandleSubRequest_WRQ(const RequestMessage &request);
+    void HandleSubRequest_RRQ(const TftpParsedRequest &request);
+    void HandleSubRequest_WRQ(const TftpParsedRequest &request);
 
     void sendErrorMsg(TftpErrorCode errorcode, std::string msg);
 
@@ -31,9 +40,11 @@ private:
     void handleOperationFinished(std::shared_ptr<TftpReceiver> finishedReceiver, TftpUserFacingErrorCode err);
 
 
-    std::optional<TransactionOptionValues> parseOptionFields(const RequestMessage &request);
+    std::optional<TransactionOptionValues> parseOptionFields(const TftpOptionTable &IN_options);
 
     boost::asio::io_context &mIoContext;
+    unsigned int mThreadCount;
+    //Acceptor socket and the lists of running transfers are only accessed on this strand
     boost::asio::strand<boost::asio::io_context::executor_type> mStrand;
     boost::asio::ip::udp::socket mAccSocket; // acceptor socket
     boost::asio::ip::udp::endpoint currAccEndpoint{};
@@ -43,16 +54,29 @@ private:
 
     std::string rootfolder;
 
+    //File contents shared by all senders, so concurrent RRQs of the same file read it from disk only once
+    std::shared_ptr<TftpBlockCache> mBlockCache;
+
+    //Disk reads and writes of all transfers, so they do not block the network threads
+    std::shared_ptr<ITftpFileIo> mFileIo;
+
+    //Large uploads bypass the page cache, so they do not evict the files that are being served
+    uint64_t mDirectIoThreshold{DEFAULT_DIRECT_IO_THRESHOLD_BYTES};
+
+    //Timeouts of all senders and receivers, re-armed on every packet
+    //Used from the strands of all transfers, it synchronizes itself with a mutex of its own
+    std::shared_ptr<TftpTimingWheel> mTimingWheel;
+
     std::vector<std::shared_ptr<Tftpsender>> mSenderList;
     std::vector<std::shared_ptr<TftpReceiver>> mReceiverList;
 
     bool stop = false;
 
-    static constexpr std::size_t NUM_SUPPORTED_OPTIONS = 3;
+    static constexpr std::size_t NUM_SUPPORTED_OPTIONS = 6;
     static const std::array<std::string, NUM_SUPPORTED_OPTIONS> supported_options;
 
 };
 
-const inline std::array<std::string, TftpServer::NUM_SUPPORTED_OPTIONS> TftpServer::supported_options = {"blksize", "timeout", "tsize"};
+const inline std::array<std::string, TftpServer::NUM_SUPPORTED_OPTIONS> TftpServer::supported_options = {"blksize", "timeout", "utimeout", "tsize", "windowsize", "rollover"};
 
 #endif // TFTPSERVER_H
@@ -0,0 +1,254 @@
+#include "tftptimingwheel.h"
+#include <algorithm>
+
+TftpTimingWheelEntry::TftpTimingWheelEntry(const boost::asio::any_io_executor &IN_executor)
+    :mExecutor(IN_executor)
+{
+}
+
+/*!
+ * \brief TftpTimingWheel::TftpTimingWheel
+ * \param IN_executor executor the ticks of the wheel run on
+ * \param IN_tick resolution of the deadlines
+ */
+TftpTimingWheel::TftpTimingWheel(const boost::asio::any_io_executor &IN_executor, std::chrono::milliseconds IN_tick)
+    :mTickTimer(IN_executor),
+    mTick(IN_tick),
+    mEpoch(std::chrono::steady_clock::now())
+{
+}
+
+void TftpTimingWheel::schedule(TftpTimingWheelEntry &IN_entry, std::chrono::milliseconds IN_duration)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    if(IN_entry.mLinked)
+    {
+        unlink(IN_entry);
+    }
+    if(!mTicking)
+    {
+        mCurrentTick = currentTimeTick();
+    }
+
+    //Rounded up so a deadline never expires early. It always lies at least one tick ahead, the slot of the current tick was already processed
+    const std::chrono::steady_clock::duration expiry_time = std::chrono::steady_clock::now() - mEpoch + IN_duration;
+    const uint64_t expiry_tick = (expiry_time + mTick - std::chrono::steady_clock::duration(1)) / mTick;
+    IN_entry.mExpiryTick = std::max(mCurrentTick + 1, expiry_tick);
+    IN_entry.mScheduledGeneration = IN_entry.mGeneration;
+    link(IN_entry);
+    ++mScheduledCount;
+
+    if(!mTicking)
+    {
+        startTicking();
+    }
+}
+
+void TftpTimingWheel::cancel(TftpTimingWheelEntry &IN_entry)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    if(IN_entry.mLinked)
+    {
+        unlink(IN_entry);
+    }
+}
+
+std::size_t TftpTimingWheel::getScheduledCount() const
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    return mScheduledCount;
+}
+
+uint64_t TftpTimingWheel::currentTimeTick() const
+{
+    return (std::chrono::steady_clock::now() - mEpoch) / mTick;
+}
+
+/*!
+ * \brief Links the entry into the slot of its expiry tick, on the lowest level whose range reaches that far
+ */
+void TftpTimingWheel::link(TftpTimingWheelEntry &IN_entry)
+{
+    constexpr uint64_t max_ticks_ahead = (uint64_t{1} << (SLOT_BITS * LEVELS)) - 1;
+    IN_entry.mExpiryTick = std::min(IN_entry.mExpiryTick, mCurrentTick + max_ticks_ahead);
+
+    const uint64_t ticks_ahead = IN_entry.mExpiryTick - mCurrentTick;
+    std::size_t level = 0;
+    while(level + 1 < LEVELS && ticks_ahead >= (uint64_t{1} << (SLOT_BITS * (level + 1))))
+    {
+        ++level;
+    }
+    TftpTimingWheelEntry *&head = mSlots[level][(IN_entry.mExpiryTick >> (SLOT_BITS * level)) & (SLOTS_PER_LEVEL - 1)];
+
+    IN_entry.mPrev = nullptr;
+    IN_entry.mNext = head;
+    if(head)
+    {
+        head->mPrev = &IN_entry;
+    }
+    head = &IN_entry;
+    IN_entry.mLinked = true;
+}
+
+void TftpTimingWheel::unlink(TftpTimingWheelEntry &IN_entry)
+{
+    if(IN_entry.mPrev)
+    {
+        IN_entry.mPrev->mNext = IN_entry.mNext;
+    }
+    else
+    {
+        //The entry is the head of its slot: find the slot through the expiry tick, like link does
+        for(std::size_t level = 0; level < LEVELS; ++level)
+        {
+            TftpTimingWheelEntry *&head = mSlots[level][(IN_entry.mExpiryTick >> (SLOT_BITS * level)) & (SLOTS_PER_LEVEL - 1)];
+            if(head == &IN_entry)
+            {
+                head = IN_entry.mNext;
+                break;
+            }
+        }
+    }
+    if(IN_entry.mNext)
+    {
+        IN_entry.mNext->mPrev = IN_entry.mPrev;
+    }
+    IN_entry.mPrev = nullptr;
+    IN_entry.mNext = nullptr;
+    IN_entry.mLinked = false;
+    --mScheduledCount;
+}
+
+void TftpTimingWheel::startTicking()
+{
+    mTicking = true;
+    mTickTimer.expires_at(mEpoch + (mCurrentTick + 1) * mTick);
+    mTickTimer.async_wait(std::bind(&TftpTimingWheel::onTick, shared_from_this(), std::placeholders::_1));
+}
+
+/*!
+ * \brief Processes all ticks that passed since the last call in one batch, and hands the expired entries to their transfers
+ */
+void TftpTimingWheel::onTick(boost::system::error_code err)
+{
+    if(err)
+    {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(mMutex);
+    const uint64_t now_tick = currentTimeTick();
+    while(mCurrentTick < now_tick && mScheduledCount > 0)
+    {
+        advanceTick();
+    }
+    //Without deadlines left the remaining ticks are empty
+    mCurrentTick = std::max(mCurrentTick, now_tick);
+
+    for(ExpiredEntry &expired : mExpired)
+    {
+        boost::asio::post(expired.executor, [entry = std::move(expired.entry), generation = expired.generation] ()
+                          {
+                              std::shared_ptr<TftpTimingWheelEntry> locked_entry = entry.lock();
+                              //The deadline was re-armed or cancelled by the transfer since it expired
+                              if(!locked_entry || locked_entry->mGeneration != generation || !locked_entry->mHandler)
+                              {
+                                  return;
+                              }
+                              std::function<void(boost::system::error_code)> handler = std::move(locked_entry->mHandler);
+                              locked_entry->mHandler = nullptr;
+                              handler(boost::system::error_code());
+                          });
+    }
+    mExpired.clear();
+
+    if(mScheduledCount > 0)
+    {
+        startTicking();
+    }
+    else
+    {
+        mTicking = false;
+    }
+}
+
+/*!
+ * \brief Advances the wheel by one tick. When the lower level wraps around, the entries of the next slot of the level above are moved down
+ */
+void TftpTimingWheel::advanceTick()
+{
+    ++mCurrentTick;
+
+    for(std::size_t level = 1; level < LEVELS; ++level)
+    {
+        if((mCurrentTick & ((uint64_t{1} << (SLOT_BITS * level)) - 1)) != 0)
+        {
+            break;
+        }
+        TftpTimingWheelEntry *entry = mSlots[level][(mCurrentTick >> (SLOT_BITS * level)) & (SLOTS_PER_LEVEL - 1)];
+        mSlots[level][(mCurrentTick >> (SLOT_BITS * level)) & (SLOTS_PER_LEVEL - 1)] = nullptr;
+        while(entry)
+        {
+            TftpTimingWheelEntry *next = entry->mNext;
+            link(*entry);
+            entry = next;
+        }
+    }
+
+    TftpTimingWheelEntry *&head = mSlots[0][mCurrentTick & (SLOTS_PER_LEVEL - 1)];
+    while(head)
+    {
+        expire(*head);
+    }
+}
+
+void TftpTimingWheel::expire(TftpTimingWheelEntry &IN_entry)
+{
+    unlink(IN_entry);
+    mExpired.push_back(ExpiredEntry{IN_entry.weak_from_this(), IN_entry.mScheduledGeneration, IN_entry.mExecutor});
+}
+
+TftpTransferTimer::TftpTransferTimer(const boost::asio::any_io_executor &IN_executor, std::shared_ptr<TftpTimingWheel> IN_wheel)
+    :mWheel(IN_wheel),
+    mEntry(std::make_shared<TftpTimingWheelEntry>(IN_executor)),
+    mOwnTimer(IN_executor)
+{
+}
+
+void TftpTransferTimer::expiresAfter(std::chrono::milliseconds IN_duration, std::function<void(boost::system::error_code)> IN_handler)
+{
+    if(mWheel)
+    {
+        ++mEntry->mGeneration;
+        mEntry->mHandler = std::move(IN_handler);
+        mWheel->schedule(*mEntry, IN_duration);
+    }
+    else
+    {
+        mOwnTimer.expires_from_now(boost::posix_time::milliseconds(IN_duration.count()));
+        mOwnTimer.async_wait(std::move(IN_handler));
+    }
+}
+
+void TftpTransferTimer::cancel()
+{
+    if(mWheel)
+    {
+        //Also drops the handler, which usually keeps the transfer alive
+        ++mEntry->mGeneration;
+        mEntry->mHandler = nullptr;
+        mWheel->cancel(*mEntry);
+    }
+    else
+    {
+        mOwnTimer.cancel();
+    }
+}
+
+TftpTransferTimer::~TftpTransferTimer()
+{
+    if(mWheel)
+    {
+        mWheel->cancel(*mEntry);
+    }
+}
@@ -0,0 +1,125 @@
+#ifndef TFTPTIMINGWHEEL_H
+#define TFTPTIMINGWHEEL_H
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <boost/asio.hpp>
+#include "tftphelpdefs.h"
+
+class TftpTimingWheel;
+
+/*
+ * One deadline of a transfer in a TftpTimingWheel. It is linked into a slot of the wheel while it is scheduled.
+ * */
+class TftpTimingWheelEntry : public std::enable_shared_from_this<TftpTimingWheelEntry>
+{
+public:
+    explicit TftpTimingWheelEntry(const boost::asio::any_io_executor &IN_executor);
+
+    TftpTimingWheelEntry(const TftpTimingWheelEntry &rhs) = delete;
+    TftpTimingWheelEntry& operator=(const TftpTimingWheelEntry &rhs) = delete;
+
+private:
+    friend class TftpTimingWheel;
+    friend class TftpTransferTimer;
+
+    boost::asio::any_io_executor mExecutor;
+
+    //Only accessed by the wheel, under the lock of the wheel
+    bool mLinked{false};
+    TftpTimingWheelEntry *mPrev{nullptr};
+    TftpTimingWheelEntry *mNext{nullptr};
+    uint64_t mExpiryTick{0};
+    uint64_t mScheduledGeneration{0};
+
+    //Only accessed on the executor of the transfer
+    uint64_t mGeneration{0};
+    std::function<void(boost::system::error_code)> mHandler;
+};
+
+/*
+ * Hierarchical timing wheel shared by all transfers of a server, so that re-arming the timeout of a transfer on every packet
+ * only relinks the entry of the transfer in O(1) instead of going through the timer queue of asio.
+ * The wheel advances in ticks of TIMING_WHEEL_TICK_MS and processes all deadlines of a tick in one batch. It only ticks while deadlines are scheduled.
+ * Expired deadlines are handed to the executor of their transfer.
+ * */
+class TftpTimingWheel : public std::enable_shared_from_this<TftpTimingWheel>
+{
+public:
+    explicit TftpTimingWheel(const boost::asio::any_io_executor &IN_executor, std::chrono::milliseconds IN_tick = std::chrono::milliseconds(TIMING_WHEEL_TICK_MS));
+
+    TftpTimingWheel(const TftpTimingWheel &rhs) = delete;
+    TftpTimingWheel& operator=(const TftpTimingWheel &rhs) = delete;
+
+    //Schedules the entry to expire after the given time, replacing its previous deadline
+    void schedule(TftpTimingWheelEntry &IN_entry, std::chrono::milliseconds IN_duration);
+    void cancel(TftpTimingWheelEntry &IN_entry);
+
+    [[nodiscard]] std::size_t getScheduledCount() const;
+
+private:
+    //With 3 levels of 256 slots, deadlines up to 2^24 ticks ahead can be held; later ones expire at that point
+    static constexpr std::size_t LEVELS = 3;
+    static constexpr unsigned int SLOT_BITS = 8;
+    static constexpr std::size_t SLOTS_PER_LEVEL = 1 << SLOT_BITS;
+
+    struct ExpiredEntry
+    {
+        std::weak_ptr<TftpTimingWheelEntry> entry;
+        uint64_t generation{0};
+        boost::asio::any_io_executor executor;
+    };
+
+    [[nodiscard]] uint64_t currentTimeTick() const;
+    void link(TftpTimingWheelEntry &IN_entry);
+    void unlink(TftpTimingWheelEntry &IN_entry);
+    void startTicking();
+    void onTick(boost::system::error_code err);
+    void advanceTick();
+    void expire(TftpTimingWheelEntry &IN_entry);
+
+    boost::asio::steady_timer mTickTimer;
+    std::chrono::steady_clock::duration mTick;
+    std::chrono::steady_clock::time_point mEpoch;
+    uint64_t mCurrentTick{0};
+    bool mTicking{false};
+    std::size_t mScheduledCount{0};
+
+    //Level 0 has one slot per tick, every slot of a higher level spans all slots of the level below it
+    std::array<std::array<TftpTimingWheelEntry*, SLOTS_PER_LEVEL>, LEVELS> mSlots{};
+    //Entries that expired in the current batch of ticks, reused so processing a batch does not allocate
+    std::vector<ExpiredEntry> mExpired;
+
+    mutable std::mutex mMutex;
+};
+
+/*
+ * Read timeout of a sender or receiver. Deadlines are kept in the timing wheel of the server if there is one,
+ * otherwise (client, standalone use) in a timer of its own.
+ * A cancelled wait may still call its handler, but only with operation_aborted.
+ * */
+class TftpTransferTimer
+{
+public:
+    TftpTransferTimer(const boost::asio::any_io_executor &IN_executor, std::shared_ptr<TftpTimingWheel> IN_wheel = {});
+
+    TftpTransferTimer(const TftpTransferTimer &rhs) = delete;
+    TftpTransferTimer& operator=(const TftpTransferTimer &rhs) = delete;
+
+    void expiresAfter(std::chrono::milliseconds IN_duration, std::function<void(boost::system::error_code)> IN_handler);
+    void cancel();
+
+    ~TftpTransferTimer();
+
+private:
+    std::shared_ptr<TftpTimingWheel> mWheel;
+    std::shared_ptr<TftpTimingWheelEntry> mEntry;
+    boost::asio::deadline_timer mOwnTimer;
+};
+
+#endif // TFTPTIMINGWHEEL_H
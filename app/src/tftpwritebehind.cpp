@@ -0,0 +1,367 @@
+#include "tftpwritebehind.h"
+#include <algorithm>
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/*!
+ * \brief TftpWriteBehind::TftpWriteBehind
+ * \param IN_output stream the received data is written to
+ * \param IN_budgetbytes amount of data that may be held before the receiver has to wait. 0 writes through directly.
+ */
+TftpWriteBehind::TftpWriteBehind(std::shared_ptr<std::ostream> IN_output, std::size_t IN_budgetbytes)
+    :mOutput(IN_output),
+    mBudget(IN_budgetbytes),
+    mChunkSize(std::min(IN_budgetbytes, WRITE_BEHIND_CHUNK_BYTES)),
+    mWriteStrand(boost::asio::make_strand(writerPool()))
+{
+    mStaging.reserve(mChunkSize);
+}
+
+TftpWriteBehind::TftpWriteBehind(int IN_fd, uint64_t IN_offset, uint64_t IN_preallocatedend, std::size_t IN_budgetbytes, std::shared_ptr<ITftpFileIo> IN_fileio, bool IN_direct)
+    :mFd(IN_fd),
+    mFileOffset(IN_offset),
+    mPreallocatedEnd(IN_preallocatedend),
+    mFileIo(IN_fileio),
+    mDirect(IN_direct),
+    mBudget(IN_budgetbytes),
+    mChunkSize(std::min(IN_budgetbytes, WRITE_BEHIND_CHUNK_BYTES)),
+    mWriteStrand(boost::asio::make_strand(writerPool()))
+{
+    mStaging.reserve(mChunkSize);
+}
+
+std::shared_ptr<TftpWriteBehind> TftpWriteBehind::openPreallocated(const std::string &IN_path, uint64_t IN_size, std::size_t IN_budgetbytes, std::error_code &OUT_error,
+                                                                   std::shared_ptr<ITftpFileIo> IN_fileio, bool IN_directio)
+{
+    //Only whole chunks written out of the aligned staging buffer can bypass the page cache, a write-through output can not
+    bool direct = IN_directio && IN_budgetbytes > 0 && std::min(IN_budgetbytes, WRITE_BEHIND_CHUNK_BYTES) % DIRECT_IO_ALIGNMENT == 0;
+    int fd = -1;
+    if(direct)
+    {
+        fd = ::open(IN_path.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC | O_DIRECT, 0644);
+        //Filesystems without direct I/O (e.g. tmpfs) reject the flag
+        if(fd < 0 && errno == EINVAL)
+        {
+            direct = false;
+        }
+    }
+    if(!direct)
+    {
+        fd = ::open(IN_path.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC, 0644);
+    }
+    if(fd < 0)
+    {
+        OUT_error = std::error_code(errno, std::generic_category());
+        return {};
+    }
+
+    //Like the stream output, an upload is appended to an existing file
+    struct stat filestat{};
+    if(fstat(fd, &filestat) != 0)
+    {
+        OUT_error = std::error_code(errno, std::generic_category());
+        ::close(fd);
+        return {};
+    }
+    if(!S_ISREG(filestat.st_mode))
+    {
+        OUT_error = std::make_error_code(std::errc::invalid_argument);
+        ::close(fd);
+        return {};
+    }
+    const uint64_t offset = filestat.st_size;
+    if(direct && offset % DIRECT_IO_ALIGNMENT != 0)
+    {
+        direct = false;
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_DIRECT);
+    }
+
+    //Allocates the whole extent at once instead of block by block with every write, which also keeps it from fragmenting.
+    //The size of the file is kept, so concurrent readers only ever see data that was actually written
+    uint64_t preallocated_end = offset;
+    if(IN_size > 0)
+    {
+        if(fallocate(fd, FALLOC_FL_KEEP_SIZE, offset, IN_size) == 0)
+        {
+            preallocated_end = offset + IN_size;
+        }
+        else if(errno == ENOSPC || errno == EFBIG)
+        {
+            OUT_error = std::error_code(errno, std::generic_category());
+            ::close(fd);
+            return {};
+        }
+    }
+
+    return std::shared_ptr<TftpWriteBehind>(new TftpWriteBehind(fd, offset, preallocated_end, IN_budgetbytes, IN_fileio, direct));
+}
+
+TftpWriteBehind::~TftpWriteBehind()
+{
+    if(mFd >= 0)
+    {
+        //An aborted transfer does not leave the unused part of the preallocation behind
+        releasePreallocation();
+        ::close(mFd);
+    }
+}
+
+bool TftpWriteBehind::isOpen() const
+{
+    return mFd >= 0 || (mOutput && *mOutput);
+}
+
+bool TftpWriteBehind::isDirect() const
+{
+    return mDirect;
+}
+
+/*!
+ * \brief Shared by the receivers of all transfers, so the amount of writer threads does not grow with the transfers
+ */
+boost::asio::thread_pool& TftpWriteBehind::writerPool()
+{
+    static boost::asio::thread_pool pool(WRITE_BEHIND_THREADS);
+    return pool;
+}
+
+void TftpWriteBehind::append(const char *IN_data, std::size_t IN_size)
+{
+    if(mBudget == 0)
+    {
+        writeOut(IN_data, IN_size);
+        return;
+    }
+
+    //Only whole chunks are handed off, so every write but the last one starts at a multiple of the chunk size
+    while(IN_size > 0)
+    {
+        const std::size_t bytes_to_stage = std::min(IN_size, mChunkSize - mStaging.size());
+        mStaging.insert(mStaging.end(), IN_data, IN_data + bytes_to_stage);
+        IN_data += bytes_to_stage;
+        IN_size -= bytes_to_stage;
+        if(mStaging.size() == mChunkSize)
+        {
+            handOffStaging();
+        }
+    }
+}
+
+bool TftpWriteBehind::isFull() const
+{
+    if(mBudget == 0)
+    {
+        return false;
+    }
+    std::lock_guard<std::mutex> lock(mMutex);
+    return mPendingBytes + mStaging.size() >= mBudget;
+}
+
+bool TftpWriteBehind::hasFailed() const
+{
+    return mFailed;
+}
+
+void TftpWriteBehind::waitWritable(const boost::asio::any_io_executor &IN_executor, std::function<void()> IN_handler)
+{
+    std::function<void()> waiter = [IN_executor, IN_handler] () { boost::asio::post(IN_executor, IN_handler); };
+    {
+        //Checked under the same lock the writer releases its bytes with, so a wakeup cannot be missed
+        std::lock_guard<std::mutex> lock(mMutex);
+        if(mPendingBytes + mStaging.size() >= mBudget && !mFailed)
+        {
+            mWritableWaiters.push_back(std::move(waiter));
+            return;
+        }
+    }
+    waiter();
+}
+
+void TftpWriteBehind::flush(const boost::asio::any_io_executor &IN_executor, std::function<void(bool)> IN_handler)
+{
+    if(mBudget == 0)
+    {
+        IN_handler(finishOutput());
+        return;
+    }
+
+    handOffStaging();
+    //The strand runs this after all chunks that were handed off before; writes that were submitted to the file I/O backend may still be running then
+    boost::asio::post(mWriteStrand, [self = shared_from_this(), IN_executor, IN_handler] ()
+                      {
+                          self->mFlushWaiter = [self, IN_executor, IN_handler] ()
+                          {
+                              const bool success = self->finishOutput();
+                              boost::asio::post(IN_executor, std::bind(IN_handler, success));
+                          };
+                          if(self->mWritesInFlight == 0)
+                          {
+                              std::function<void()> waiter = std::move(self->mFlushWaiter);
+                              self->mFlushWaiter = nullptr;
+                              waiter();
+                          }
+                      });
+}
+
+void TftpWriteBehind::handOffStaging()
+{
+    if(mStaging.empty())
+    {
+        return;
+    }
+
+    ChunkBuffer chunk;
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mPendingBytes += mStaging.size();
+        chunk.swap(mStaging);
+        //Chunks are reused, so a running transfer does not allocate
+        if(!mFreeChunks.empty())
+        {
+            mStaging = std::move(mFreeChunks.back());
+            mFreeChunks.pop_back();
+        }
+    }
+    mStaging.clear();
+    mStaging.reserve(mChunkSize);
+
+    boost::asio::post(mWriteStrand, [self = shared_from_this(), chunk = std::move(chunk)] () mutable
+                      {
+                          self->writeChunk(std::move(chunk));
+                      });
+}
+
+/*!
+ * \brief Runs on the writer pool
+ */
+void TftpWriteBehind::writeChunk(ChunkBuffer &&IN_chunk)
+{
+    //The unaligned last chunk is written synchronously, it changes the file descriptor from direct to buffered I/O
+    if(!mFileIo || mFd < 0 || mFailed || (mDirect && IN_chunk.size() % DIRECT_IO_ALIGNMENT != 0))
+    {
+        writeOut(IN_chunk.data(), IN_chunk.size());
+        onChunkWritten(std::move(IN_chunk));
+        return;
+    }
+
+    //The offset is taken when the write is submitted, so chunks that are written concurrently still end up in order
+    std::shared_ptr<ChunkBuffer> chunk = std::make_shared<ChunkBuffer>(std::move(IN_chunk));
+    const uint64_t offset = mFileOffset;
+    mFileOffset += chunk->size();
+    ++mWritesInFlight;
+    mFileIo->writeAll(mFd, offset, chunk->data(), chunk->size(), mWriteStrand, [self = shared_from_this(), chunk] (bool success)
+                      {
+                          if(!success)
+                          {
+                              self->mFailed = true;
+                          }
+                          --self->mWritesInFlight;
+                          self->onChunkWritten(std::move(*chunk));
+                      });
+}
+
+/*!
+ * \brief Runs on the write strand. Returns the memory of the chunk to the budget and wakes up everyone waiting for it.
+ */
+void TftpWriteBehind::onChunkWritten(ChunkBuffer &&IN_chunk)
+{
+    std::vector<std::function<void()>> waiters;
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mPendingBytes -= IN_chunk.size();
+        IN_chunk.clear();
+        mFreeChunks.push_back(std::move(IN_chunk));
+        waiters.swap(mWritableWaiters);
+    }
+    for(std::function<void()> &waiter : waiters)
+    {
+        waiter();
+    }
+
+    if(mWritesInFlight == 0 && mFlushWaiter)
+    {
+        std::function<void()> waiter = std::move(mFlushWaiter);
+        mFlushWaiter = nullptr;
+        waiter();
+    }
+}
+
+void TftpWriteBehind::writeOut(const char *IN_data, std::size_t IN_size)
+{
+    if(mFailed)
+    {
+        return;
+    }
+
+    if(mFd < 0)
+    {
+        mOutput->write(IN_data, IN_size);
+        if(!*mOutput)
+        {
+            mFailed = true;
+        }
+        return;
+    }
+
+    //Direct I/O needs whole aligned blocks; the rest at the end of the transfer is written through the page cache
+    if(mDirect && IN_size % DIRECT_IO_ALIGNMENT != 0)
+    {
+        const std::size_t aligned_size = IN_size - IN_size % DIRECT_IO_ALIGNMENT;
+        writeOut(IN_data, aligned_size);
+        fcntl(mFd, F_SETFL, fcntl(mFd, F_GETFL) & ~O_DIRECT);
+        mDirect = false;
+        IN_data += aligned_size;
+        IN_size -= aligned_size;
+    }
+
+    while(IN_size > 0)
+    {
+        const ssize_t written = pwrite(mFd, IN_data, IN_size, mFileOffset);
+        if(written < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if(written <= 0)
+        {
+            mFailed = true;
+            return;
+        }
+        IN_data += written;
+        IN_size -= written;
+        mFileOffset += written;
+    }
+}
+
+/*!
+ * \brief Flushes the stream. The unused part of a preallocated file is released, in case the peer sent less than it announced.
+ */
+bool TftpWriteBehind::finishOutput()
+{
+    if(mFd < 0)
+    {
+        if(!mFailed && !mOutput->flush())
+        {
+            mFailed = true;
+        }
+    }
+    else
+    {
+        releasePreallocation();
+    }
+    return !mFailed;
+}
+
+/*!
+ * \brief Frees the preallocated blocks behind the written data. The file is not truncated, since that would cut away pages that a reader may have mapped.
+ * Filesystems that can not punch holes keep the blocks, the content of the file is correct either way.
+ */
+void TftpWriteBehind::releasePreallocation()
+{
+    if(mFileOffset < mPreallocatedEnd)
+    {
+        static_cast<void>(fallocate(mFd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, mFileOffset, mPreallocatedEnd - mFileOffset));
+        mPreallocatedEnd = mFileOffset;
+    }
+}
@@ -0,0 +1,136 @@
+#ifndef TFTPWRITEBEHIND_H
+#define TFTPWRITEBEHIND_H
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <ostream>
+#include <string>
+#include <system_error>
+#include <vector>
+#include <boost/asio.hpp>
+#include "tftpfileio.h"
+#include "tftphelpdefs.h"
+
+/*
+ * Allocates memory aligned for direct I/O
+ * */
+template<typename T, std::size_t ALIGNMENT>
+struct TftpAlignedAllocator
+{
+    using value_type = T;
+
+    template<typename U>
+    struct rebind
+    {
+        using other = TftpAlignedAllocator<U, ALIGNMENT>;
+    };
+
+    TftpAlignedAllocator() = default;
+    template<typename U>
+    TftpAlignedAllocator(const TftpAlignedAllocator<U, ALIGNMENT>&) {}
+
+    T* allocate(std::size_t IN_count)
+    {
+        return static_cast<T*>(::operator new(IN_count * sizeof(T), std::align_val_t(ALIGNMENT)));
+    }
+    void deallocate(T *IN_pointer, std::size_t)
+    {
+        ::operator delete(IN_pointer, std::align_val_t(ALIGNMENT));
+    }
+
+    template<typename U>
+    bool operator==(const TftpAlignedAllocator<U, ALIGNMENT>&) const { return true; }
+    template<typename U>
+    bool operator!=(const TftpAlignedAllocator<U, ALIGNMENT>&) const { return false; }
+};
+
+/*
+ * Write-behind stage between a receiver and its output stream.
+ * Received payloads are appended to a staging chunk on the network side. Full chunks of WRITE_BEHIND_CHUNK_BYTES are written
+ * to the stream on a shared pool of writer threads, so a slow disk does not delay the ACKs of the receiver.
+ * The memory of a transfer is bounded: when the staged and not yet written data reaches the budget, the receiver waits with its next ACK
+ * until the writer caught up, which throttles the sender.
+ * With a budget of 0, every payload is written directly into the stream.
+ * Instead of a stream, the output can be a file that was preallocated for the announced size of the transfer, which is then written with positional writes,
+ * optionally submitted through a file I/O backend so the writer threads do not block on the disk either.
+ * Large uploads can be written to the preallocated file with direct I/O, so they do not push the files that are being served out of the page cache.
+ * */
+class TftpWriteBehind : public std::enable_shared_from_this<TftpWriteBehind>
+{
+public:
+    TftpWriteBehind(std::shared_ptr<std::ostream> IN_output, std::size_t IN_budgetbytes = 0);
+
+    //Opens the file for appending the transfer and reserves IN_size bytes on disk for it. The size of the file only grows as the data is written.
+    //Returns nothing if the file can not be opened or there is not enough space (ENOSPC); filesystems without preallocation are written without it.
+    //Direct I/O is only used if the filesystem supports it and the file ends at an aligned offset; otherwise the page cache is used as usual.
+    [[nodiscard]] static std::shared_ptr<TftpWriteBehind> openPreallocated(const std::string &IN_path, uint64_t IN_size, std::size_t IN_budgetbytes, std::error_code &OUT_error,
+                                                                           std::shared_ptr<ITftpFileIo> IN_fileio = {}, bool IN_directio = false);
+
+    TftpWriteBehind(const TftpWriteBehind &rhs) = delete;
+    TftpWriteBehind& operator=(const TftpWriteBehind &rhs) = delete;
+
+    ~TftpWriteBehind();
+
+    [[nodiscard]] bool isOpen() const;
+    [[nodiscard]] bool isDirect() const;
+
+    void append(const char *IN_data, std::size_t IN_size);
+
+    //Whether the data that is not written yet reached the budget
+    [[nodiscard]] bool isFull() const;
+    [[nodiscard]] bool hasFailed() const;
+
+    //Calls the handler on the given executor as soon as the data that is not written yet is below the budget again (or writing failed)
+    void waitWritable(const boost::asio::any_io_executor &IN_executor, std::function<void()> IN_handler);
+    //Writes all appended data and calls the handler on the given executor once it is in the stream. The handler gets whether all writes succeeded.
+    void flush(const boost::asio::any_io_executor &IN_executor, std::function<void(bool)> IN_handler);
+
+private:
+    //Chunks are aligned, so they can be written with direct I/O
+    using ChunkBuffer = std::vector<char, TftpAlignedAllocator<char, DIRECT_IO_ALIGNMENT>>;
+
+    TftpWriteBehind(int IN_fd, uint64_t IN_offset, uint64_t IN_preallocatedend, std::size_t IN_budgetbytes, std::shared_ptr<ITftpFileIo> IN_fileio, bool IN_direct);
+
+    static boost::asio::thread_pool& writerPool();
+
+    void handOffStaging();
+    void writeChunk(ChunkBuffer &&IN_chunk);
+    void onChunkWritten(ChunkBuffer &&IN_chunk);
+    //Writes into the stream, or at the current file offset
+    void writeOut(const char *IN_data, std::size_t IN_size);
+    bool finishOutput();
+    void releasePreallocation();
+
+    std::shared_ptr<std::ostream> mOutput;
+    //Used instead of the stream if the output is a preallocated file. Only the writer touches the offset.
+    int mFd{-1};
+    uint64_t mFileOffset{0};
+    uint64_t mPreallocatedEnd{0};
+    std::shared_ptr<ITftpFileIo> mFileIo;
+    //The file descriptor was opened with O_DIRECT. Dropped for the unaligned tail of the transfer
+    std::atomic_bool mDirect{false};
+    std::size_t mBudget;
+    std::size_t mChunkSize;
+
+    //Only accessed on the network side
+    ChunkBuffer mStaging;
+
+    //Writes of one transfer stay in order
+    boost::asio::strand<boost::asio::thread_pool::executor_type> mWriteStrand;
+    //Only accessed on the write strand: chunks submitted to the file I/O backend that did not complete yet, and the flush that waits for them
+    std::size_t mWritesInFlight{0};
+    std::function<void()> mFlushWaiter;
+
+    //Shared between the network side and the writer
+    mutable std::mutex mMutex;
+    std::size_t mPendingBytes{0};
+    std::vector<ChunkBuffer> mFreeChunks;
+    std::vector<std::function<void()>> mWritableWaiters;
+    std::atomic_bool mFailed{false};
+};
+
+#endif // TFTPWRITEBEHIND_H
@@ -0,0 +1,232 @@
+#include <gmock/gmock-matchers.h>
+#include <gtest/gtest.h>
+
+#include "tftpblockcache.h"
+#include "tftpblocksource.h"
+#include "tftphelpdefs.h"
+#include <fstream>
+#include <sstream>
+
+using namespace testing;
+
+static constexpr std::size_t BLKSIZE = 512;
+
+static std::string makeTestInput(std::size_t size)
+{
+    std::string input;
+    for(std::size_t i = 0; i < size; ++i)
+    {
+        input.push_back(static_cast<char>(i * 7 + i / BLKSIZE));
+    }
+    return input;
+}
+
+static bool blockEquals(const std::optional<boost::asio::const_buffer> &block, const std::string &input, std::size_t blockindex)
+{
+    if(!block.has_value())
+    {
+        return false;
+    }
+    const std::size_t expectedsize = std::min(BLKSIZE, input.size() - blockindex * BLKSIZE);
+    return block->size() == expectedsize
+           && std::equal(input.begin() + blockindex * BLKSIZE, input.begin() + blockindex * BLKSIZE + expectedsize, static_cast<const char*>(block->data()));
+}
+
+//Test if all blocks are supplied correctly when reading sequentially, including the half filled last block
+TEST(TTFTPBlockSource, SequentialBlocksCorrect)
+{
+    const std::string input = makeTestInput(BLKSIZE * 20 + 10);
+    TftpStreamBlockSource source(std::make_shared<std::istringstream>(input, std::ios_base::binary), BLKSIZE, 8);
+
+    for(std::size_t blockindex = 0; blockindex <= 20; ++blockindex)
+    {
+        EXPECT_TRUE(blockEquals(source.getBlock(blockindex), input, blockindex));
+        source.releaseBlocksBefore(blockindex);
+    }
+    EXPECT_EQ(source.getBlock(20)->size(), 10);
+    EXPECT_FALSE(source.getBlock(21).has_value());
+}
+
+//Test if an input that ends with a full block is followed by an empty last block
+TEST(TTFTPBlockSource, EmptyLastBlockAfterFullBlock)
+{
+    const std::string input = makeTestInput(BLKSIZE * 4);
+    TftpStreamBlockSource source(std::make_shared<std::istringstream>(input, std::ios_base::binary), BLKSIZE, 8);
+
+    for(std::size_t blockindex = 0; blockindex < 4; ++blockindex)
+    {
+        EXPECT_TRUE(blockEquals(source.getBlock(blockindex), input, blockindex));
+    }
+    ASSERT_TRUE(source.getBlock(4).has_value());
+    EXPECT_EQ(source.getBlock(4)->size(), 0);
+    EXPECT_FALSE(source.getBlock(5).has_value());
+}
+
+//Test if a window can be resent from the ring, and if blocks that were already overwritten are read from the stream again
+TEST(TTFTPBlockSource, ResendWindowAndOverwrittenBlocks)
+{
+    const std::string input = makeTestInput(BLKSIZE * 30 + 100);
+    TftpStreamBlockSource source(std::make_shared<std::istringstream>(input, std::ios_base::binary), BLKSIZE, 4);
+
+    for(std::size_t blockindex = 0; blockindex < 12; ++blockindex)
+    {
+        EXPECT_TRUE(blockEquals(source.getBlock(blockindex), input, blockindex));
+    }
+    //Current window is 8 to 11
+    source.releaseBlocksBefore(8);
+    for(std::size_t blockindex = 8; blockindex < 12; ++blockindex)
+    {
+        EXPECT_TRUE(blockEquals(source.getBlock(blockindex), input, blockindex));
+    }
+
+    //Far behind the ring and up to the end of the input
+    for(std::size_t blockindex = 2; blockindex <= 30; ++blockindex)
+    {
+        EXPECT_TRUE(blockEquals(source.getBlock(blockindex), input, blockindex));
+    }
+
+    //Resend of the last block after the end was reached
+    EXPECT_TRUE(blockEquals(source.getBlock(30), input, 30));
+    EXPECT_TRUE(blockEquals(source.getBlock(27), input, 27));
+}
+
+//Test if the ring of a transfer with the largest window and block size a peer can choose stays within its memory cap
+TEST(TTFTPBlockSource, StreamRingCappedInBytes)
+{
+    constexpr std::size_t LARGE_BLKSIZE = 65464;
+    const std::string input = makeTestInput(LARGE_BLKSIZE * 3);
+    std::shared_ptr<ITftpBlockSource> source = makeStreamBlockSource(std::make_shared<std::istringstream>(input, std::ios_base::binary), LARGE_BLKSIZE, 65535);
+    ASSERT_TRUE(source);
+    EXPECT_LE(source->maxHeldBlocks() * LARGE_BLKSIZE, READ_AHEAD_RING_BYTES);
+    EXPECT_GE(source->maxHeldBlocks(), 1);
+    for(std::size_t blockindex = 0; blockindex <= 3; ++blockindex)
+    {
+        std::optional<boost::asio::const_buffer> block = source->getBlock(blockindex);
+        ASSERT_TRUE(block.has_value());
+        EXPECT_EQ(block->size(), blockindex < 3 ? LARGE_BLKSIZE : 0);
+    }
+}
+
+//Test if no block is supplied when the input can not be read
+TEST(TTFTPBlockSource, NoBlockFromInvalidInput)
+{
+    std::shared_ptr<std::istream> ifs = std::make_shared<std::ifstream>("non_existing_file_for_blocksource_test", std::ios_base::binary);
+    TftpStreamBlockSource source(ifs, BLKSIZE, 8);
+    EXPECT_FALSE(source.getBlock(0).has_value());
+}
+
+//Test if two transfers of the same file get the correct blocks, and the file is read from disk only once
+TEST(TTFTPBlockSource, CacheSharedBetweenTransfers)
+{
+    const std::string filename = "CachedBlockSourceTestFile.bin";
+    const std::string input = makeTestInput(BLKSIZE * 1200 + 100);
+    {
+        std::ofstream ofs(filename, std::ios_base::binary);
+        ofs.write(input.data(), input.size());
+    }
+
+    std::shared_ptr<TftpBlockCache> cache = std::make_shared<TftpBlockCache>();
+    std::shared_ptr<TftpCachedBlockSource> first = TftpCachedBlockSource::open(cache, filename, BLKSIZE);
+    std::shared_ptr<TftpCachedBlockSource> second = TftpCachedBlockSource::open(cache, filename, BLKSIZE);
+    ASSERT_TRUE(first);
+    ASSERT_TRUE(second);
+
+    for(std::size_t blockindex = 0; blockindex <= 1200; ++blockindex)
+    {
+        EXPECT_TRUE(blockEquals(first->getBlock(blockindex), input, blockindex));
+        first->releaseBlocksBefore(blockindex);
+    }
+    const std::size_t reads_of_first_transfer = cache->getReadCount();
+    for(std::size_t blockindex = 0; blockindex <= 1200; ++blockindex)
+    {
+        EXPECT_TRUE(blockEquals(second->getBlock(blockindex), input, blockindex));
+        second->releaseBlocksBefore(blockindex);
+    }
+    EXPECT_EQ(cache->getReadCount(), reads_of_first_transfer);
+    EXPECT_FALSE(second->getBlock(1201).has_value());
+    std::remove(filename.c_str());
+}
+
+//Test if the cache stays within its budget, while blocks that are held by a transfer stay valid
+TEST(TTFTPBlockSource, CacheEvictsWithinBudget)
+{
+    const std::string filename = "CachedBlockSourceBudgetTestFile.bin";
+    const std::size_t chunkbytes = TftpBlockCache::blocksPerChunk(BLKSIZE) * BLKSIZE;
+    const std::string input = makeTestInput(chunkbytes * 6);
+    {
+        std::ofstream ofs(filename, std::ios_base::binary);
+        ofs.write(input.data(), input.size());
+    }
+
+    std::shared_ptr<TftpBlockCache> cache = std::make_shared<TftpBlockCache>(chunkbytes * 2);
+    std::shared_ptr<TftpCachedBlockSource> source = TftpCachedBlockSource::open(cache, filename, BLKSIZE);
+    ASSERT_TRUE(source);
+
+    const std::size_t blocks = input.size() / BLKSIZE;
+    for(std::size_t blockindex = 0; blockindex < blocks; ++blockindex)
+    {
+        EXPECT_TRUE(blockEquals(source->getBlock(blockindex), input, blockindex));
+        source->releaseBlocksBefore(blockindex);
+        EXPECT_LE(cache->getUsedBytes(), chunkbytes * 2);
+    }
+    EXPECT_EQ(cache->getReadCount(), 6);
+    std::remove(filename.c_str());
+}
+
+//Test if a source with a file I/O backend reads missing chunks asynchronously before the blocks are requested, and reads the next chunk ahead
+TEST(TTFTPBlockSource, CachePreparesBlocksAsynchronously)
+{
+    const std::string filename = "CachedBlockSourceAsyncTestFile.bin";
+    const std::size_t blocksperchunk = TftpBlockCache::blocksPerChunk(BLKSIZE);
+    const std::string input = makeTestInput(blocksperchunk * BLKSIZE * 3 + 100);
+    {
+        std::ofstream ofs(filename, std::ios_base::binary);
+        ofs.write(input.data(), input.size());
+    }
+
+    boost::asio::io_context testIoContext;
+    std::shared_ptr<TftpBlockCache> cache = std::make_shared<TftpBlockCache>();
+    std::shared_ptr<TftpCachedBlockSource> source = TftpCachedBlockSource::open(cache, filename, BLKSIZE, makeFileIo(TftpFileIoBackend::THREADS));
+    ASSERT_TRUE(source);
+
+    //Prepares the blocks, running the context until the source called back as often as it needs to read chunks
+    const auto prepare = [&testIoContext, &source] (uint64_t firstblock, uint64_t endblock)
+    {
+        for(int reads = 0; reads < 4; ++reads)
+        {
+            bool called = false;
+            auto work = boost::asio::make_work_guard(testIoContext);
+            if(source->prepareBlocks(firstblock, endblock, testIoContext.get_executor(), [&called, &work] () { called = true; work.reset(); }))
+            {
+                return true;
+            }
+            testIoContext.restart();
+            testIoContext.run();
+            if(!called)
+            {
+                return false;
+            }
+        }
+        return false;
+    };
+
+    //The first window misses the cache. Once it is there, the next chunk is read ahead, so the window after it only waits for that read
+    EXPECT_FALSE(source->prepareBlocks(0, 16, testIoContext.get_executor(), [] () {}));
+    EXPECT_TRUE(prepare(0, 16));
+    EXPECT_EQ(cache->getReadCount(), 1);
+    EXPECT_TRUE(prepare(blocksperchunk, blocksperchunk + 16));
+    EXPECT_EQ(cache->getReadCount(), 2);
+
+    const std::size_t blocks = input.size() / BLKSIZE;
+    for(std::size_t blockindex = 0; blockindex <= blocks; blockindex += 16)
+    {
+        EXPECT_TRUE(prepare(blockindex, blockindex + 16));
+        for(std::size_t block = blockindex; block < std::min(blockindex + 16, blocks + 1); ++block)
+        {
+            EXPECT_TRUE(blockEquals(source->getBlock(block), input, block));
+        }
+        source->releaseBlocksBefore(blockindex);
+    }
+    EXPECT_EQ(cache->getReadCount(), 4);
+    std::remove(filename.c_str());
+}
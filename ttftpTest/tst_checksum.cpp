@@ -0,0 +1,35 @@
+#include <gmock/gmock-matchers.h>
+#include <gtest/gtest.h>
+
+#include <string>
+#include "tftpchecksum.h"
+
+using namespace testing;
+
+//Test the check value of CRC32C and the checksum of no data
+TEST(TTFTPChecksum, KnownValues)
+{
+    const std::string check = "123456789";
+    EXPECT_EQ(TftpChecksum::compute(check.data(), check.size()), 0xE3069283u);
+    EXPECT_EQ(TftpChecksum::compute(nullptr, 0), 0u);
+}
+
+//Test if updating with arbitrary pieces gives the same checksum as computing it over the whole data at once
+TEST(TTFTPChecksum, StreamingEqualsOneShot)
+{
+    std::string input;
+    for(std::size_t i = 0; i < 100000; ++i)
+    {
+        input.push_back(rand());
+    }
+
+    TftpChecksum checksum;
+    std::size_t pos = 0;
+    for(std::size_t piece = 1; pos < input.size(); piece = piece * 3 + 1)
+    {
+        const std::size_t size = std::min(piece % 1500, input.size() - pos);
+        checksum.update(input.data() + pos, size);
+        pos += size;
+    }
+    EXPECT_EQ(checksum.value(), TftpChecksum::compute(input.data(), input.size()));
+}
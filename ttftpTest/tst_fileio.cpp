@@ -0,0 +1,77 @@
+#include <gmock/gmock-matchers.h>
+#include <gtest/gtest.h>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <string>
+#include "tftpfileio.h"
+
+using namespace testing;
+
+using FileOperation = std::function<void(const boost::asio::any_io_executor&, std::function<void(bool)>)>;
+
+//Runs a context until the operation called its handler, and returns the result of the operation
+static bool runOperation(const FileOperation &IN_operation)
+{
+    boost::asio::io_context testIoContext;
+    auto work = boost::asio::make_work_guard(testIoContext);
+    bool succeeded = false;
+    IN_operation(testIoContext.get_executor(), [&succeeded, &work] (bool success) { succeeded = success; work.reset(); });
+    testIoContext.run();
+    return succeeded;
+}
+
+//Writes a file through the backend, reads it back and checks that a read past the end fails
+static void writeAndReadBack(const std::shared_ptr<ITftpFileIo> &IN_fileio, const std::string &IN_filename)
+{
+    std::string input;
+    for(std::size_t i = 0; i < 300 * 1024 + 5; ++i)
+    {
+        input.push_back(rand());
+    }
+
+    const int fd = ::open(IN_filename.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    ASSERT_GE(fd, 0);
+
+    EXPECT_TRUE(runOperation([&] (const boost::asio::any_io_executor &executor, std::function<void(bool)> handler)
+                             {
+                                 IN_fileio->writeAll(fd, 0, input.data(), input.size(), executor, handler);
+                             }));
+
+    std::string output(input.size(), '\0');
+    EXPECT_TRUE(runOperation([&] (const boost::asio::any_io_executor &executor, std::function<void(bool)> handler)
+                             {
+                                 IN_fileio->readAll(fd, 0, output.data(), output.size(), executor, handler);
+                             }));
+    EXPECT_TRUE(output == input);
+
+    //Reading past the end of the file is an error, the caller expects the whole range
+    EXPECT_FALSE(runOperation([&] (const boost::asio::any_io_executor &executor, std::function<void(bool)> handler)
+                              {
+                                  IN_fileio->readAll(fd, input.size() - 10, output.data(), 20, executor, handler);
+                              }));
+
+    ::close(fd);
+    std::remove(IN_filename.c_str());
+}
+
+//Test if the thread pool backend reads and writes whole ranges
+TEST(TTFTPFileIo, ThreadPoolReadWriteCorrect)
+{
+    writeAndReadBack(makeFileIo(TftpFileIoBackend::THREADS), "FileIoThreadsTestFile.bin");
+}
+
+//Test if the io_uring backend reads and writes whole ranges, where the kernel supports it
+TEST(TTFTPFileIo, UringReadWriteCorrect)
+{
+#ifdef TTFTP_HAS_IO_URING
+    std::shared_ptr<ITftpFileIo> fileio = TftpUringFileIo::create();
+    if(!fileio)
+    {
+        GTEST_SKIP() << "io_uring not available";
+    }
+    writeAndReadBack(fileio, "FileIoUringTestFile.bin");
+#else
+    GTEST_SKIP() << "io_uring not available";
+#endif
+}
@@ -0,0 +1,271 @@
+#include <gmock/gmock-matchers.h>
+#include <gtest/gtest.h>
+
+#include <array>
+#include <string>
+#include <type_traits>
+#include "tftpmessages.h"
+#include "tftppacketlayout.h"
+
+using namespace testing;
+
+//Test if every message encoded into a buffer is the same as its string encoding, and decodes back from the buffer
+TEST(TTFTPMessages, EncodeIntoEqualsEncode)
+{
+    std::array<char, 1024> packet;
+
+    RequestMessage request;
+    request.setRRQ();
+    request.setFilename("file.bin");
+    request.setMode(TftpMode::OCTET);
+    request.setOptVals(std::map<std::string, std::string>{{"blksize", "1428"}, {"windowsize", "16"}});
+    std::size_t size = request.encodeInto(boost::asio::buffer(packet));
+    EXPECT_EQ(std::string(packet.data(), size), request.encode());
+    RequestMessage decodedrequest;
+    EXPECT_TRUE(decodedrequest.decode(boost::asio::buffer(packet.data(), size)));
+    EXPECT_TRUE(decodedrequest.isRRQ());
+    EXPECT_EQ(decodedrequest.getFilename(), "file.bin");
+    EXPECT_EQ(decodedrequest.getMode(), TftpMode::OCTET);
+    EXPECT_EQ(decodedrequest.getOptVals(), request.getOptVals());
+
+    DataMessage data(4);
+    data.setBlockNr(7);
+    data.setData(std::string("abcd"));
+    size = data.encodeInto(boost::asio::buffer(packet));
+    EXPECT_EQ(std::string(packet.data(), size), data.encode());
+    DataMessage decodeddata(4);
+    EXPECT_TRUE(decodeddata.decode(boost::asio::buffer(packet.data(), size)));
+    EXPECT_EQ(decodeddata, data);
+
+    AckMessage ack;
+    ack.setBlockNr(65535);
+    size = ack.encodeInto(boost::asio::buffer(packet));
+    EXPECT_EQ(std::string(packet.data(), size), ack.encode());
+    AckMessage decodedack;
+    EXPECT_TRUE(decodedack.decode(boost::asio::buffer(packet.data(), size)));
+    EXPECT_EQ(decodedack, ack);
+
+    ErrorMessage error;
+    error.setErrorCode(static_cast<error_code_t>(TftpErrorCode::ERR_DISK_FULL));
+    error.setErrorMsg("disk full");
+    size = error.encodeInto(boost::asio::buffer(packet));
+    EXPECT_EQ(std::string(packet.data(), size), error.encode());
+    ErrorMessage decodederror;
+    EXPECT_TRUE(decodederror.decode(boost::asio::buffer(packet.data(), size)));
+    EXPECT_EQ(decodederror, error);
+
+    OptionACKMessage oack;
+    oack.setOptVals(std::map<std::string, std::string>{{"tsize", "123456"}});
+    size = oack.encodeInto(boost::asio::buffer(packet));
+    EXPECT_EQ(std::string(packet.data(), size), oack.encode());
+    OptionACKMessage decodedoack;
+    EXPECT_TRUE(decodedoack.decode(boost::asio::buffer(packet.data(), size)));
+    EXPECT_EQ(decodedoack.getOptVals(), oack.getOptVals());
+}
+
+//Test if a buffer that is too small is not written to, and truncated packets are not read beyond their end
+TEST(TTFTPMessages, BufferBoundsRespected)
+{
+    AckMessage ack;
+    ack.setBlockNr(1);
+    std::array<char, OPCODELENGTH + BLOCKNRLENGTH - 1> smallpacket{};
+    EXPECT_EQ(ack.encodeInto(boost::asio::buffer(smallpacket)), 0u);
+    EXPECT_FALSE(ack.decode(boost::asio::buffer(ack.encode().data(), OPCODELENGTH)));
+
+    //A request whose mode is not 0 terminated is invalid, the mode is not read beyond the end of the packet
+    RequestMessage request;
+    request.setWRQ();
+    request.setFilename("name");
+    request.setMode(TftpMode::OCTET);
+    const std::string encoded = request.encode();
+    RequestMessage decodedrequest;
+    EXPECT_FALSE(decodedrequest.decode(boost::asio::buffer(encoded.data(), encoded.size() - 1)));
+    EXPECT_TRUE(decodedrequest.decode(boost::asio::buffer(encoded)));
+    EXPECT_EQ(decodedrequest.getMode(), TftpMode::OCTET);
+    EXPECT_FALSE(decodedrequest.decode(boost::asio::buffer(encoded.data(), OPCODELENGTH + 4)));
+
+    //An option without a value is invalid
+    const std::string withoption = encoded + "blksize";
+    EXPECT_FALSE(decodedrequest.decode(boost::asio::buffer(withoption)));
+}
+
+//Test if parsePacket classifies every kind of packet by its opcode, and refers to the fields inside the packet
+TEST(TTFTPMessages, ParsePacketClassifiesOpcodes)
+{
+    RequestMessage request;
+    request.setWRQ();
+    request.setFilename("name");
+    request.setMode(TftpMode::OCTET);
+    const std::string requestpacket = request.encode();
+    const TftpPacketView requestpacketview = parsePacket(boost::asio::buffer(requestpacket));
+    const TftpRequestView *requestview = std::get_if<TftpRequestView>(&requestpacketview);
+    ASSERT_NE(requestview, nullptr);
+    EXPECT_EQ(requestview->opcode, TftpOpcode::WRQ);
+
+    DataMessage data(4);
+    data.setBlockNr(3);
+    data.setData(std::string("wxyz"));
+    const std::string datapacket = data.encode();
+    const TftpPacketView dataview = parsePacket(boost::asio::buffer(datapacket), 4);
+    ASSERT_TRUE(std::holds_alternative<TftpDataView>(dataview));
+    EXPECT_EQ(std::get<TftpDataView>(dataview).blockNr, 3);
+    EXPECT_EQ(std::get<TftpDataView>(dataview).payload.data(), datapacket.data() + CONTROLBYTES);
+    EXPECT_EQ(std::get<TftpDataView>(dataview).payload.size(), 4u);
+    //More payload than the blocksize
+    EXPECT_TRUE(std::holds_alternative<TftpInvalidPacketView>(parsePacket(boost::asio::buffer(datapacket), 3)));
+
+    AckMessage ack;
+    ack.setBlockNr(42);
+    const std::string ackpacket = ack.encode();
+    ErrorMessage error;
+    error.setErrorCode(static_cast<error_code_t>(TftpErrorCode::ERR_FILE_NOT_FOUND));
+    error.setErrorMsg("not found");
+    const std::string errorpacket = error.encode();
+    OptionACKMessage oack;
+    oack.setOptVals(std::map<std::string, std::string>{{"blksize", "1024"}});
+    const std::string oackpacket = oack.encode();
+
+    //Every packet is handled by exactly one branch of a visitor
+    auto describe = [] (const TftpPacketView &IN_packet)
+    {
+        return std::visit([] (const auto &view) -> std::string
+                          {
+                              using View = std::decay_t<decltype(view)>;
+                              if constexpr(std::is_same_v<View, TftpAckView>)
+                                  return "ACK " + std::to_string(view.blockNr);
+                              else if constexpr(std::is_same_v<View, TftpErrorView>)
+                                  return "ERROR " + std::to_string(view.errorCode) + " " + std::string(view.message);
+                              else if constexpr(std::is_same_v<View, TftpOptionACKView>)
+                              {
+                                  OptionACKMessage decoded;
+                                  return decoded.decode(view.packet) ? "OACK " + decoded.getOptVals().at("blksize") : "broken OACK";
+                              }
+                              else if constexpr(std::is_same_v<View, TftpInvalidPacketView>)
+                                  return "invalid";
+                              else
+                                  return "other";
+                          }, IN_packet);
+    };
+    EXPECT_EQ(describe(parsePacket(boost::asio::buffer(ackpacket))), "ACK 42");
+    EXPECT_EQ(describe(parsePacket(boost::asio::buffer(errorpacket))), "ERROR 1 not found");
+    EXPECT_EQ(describe(parsePacket(boost::asio::buffer(oackpacket))), "OACK 1024");
+    EXPECT_EQ(describe(parsePacket(boost::asio::buffer(ackpacket.data(), 3))), "invalid");
+    EXPECT_EQ(describe(parsePacket(boost::asio::buffer(std::string("\x00\x09", 2)))), "invalid");
+}
+
+//Test if a request is parsed in place, with option names and mode matched without regard to case
+TEST(TTFTPMessages, RequestOptionsParsedInPlace)
+{
+    const std::string packet("\x00\x02upload.bin\x00OcTeT\x00" "BLKSIZE\x00" "1428\x00WindowSize\x00" "16\x00tsize\x00" "0\x00unknown\x00x\x00", 64);
+
+    TftpParsedRequest request;
+    ASSERT_TRUE(RequestMessage::decodeInPlace(boost::asio::buffer(packet), request));
+    EXPECT_EQ(request.opcode, TftpOpcode::WRQ);
+    EXPECT_EQ(request.filename, "upload.bin");
+    EXPECT_EQ(request.mode, TftpMode::OCTET);
+    EXPECT_EQ(request.options.size(), 4);
+    //The table refers into the packet, nothing is copied
+    EXPECT_EQ(request.options.find("blksize")->data(), packet.data() + 27);
+    EXPECT_FALSE(request.options.find("rollover").has_value());
+
+    TransactionOptionValues values;
+    EXPECT_TRUE(values.setOptionsFromTable(request.options));
+    EXPECT_EQ(values.mBlocksize, 1428);
+    EXPECT_EQ(values.mWindowsize, 16);
+    EXPECT_EQ(values.mTransferSize, 0);
+
+    //A repeated option replaces the earlier value
+    TftpOptionTable table;
+    EXPECT_TRUE(table.add("blksize", "512"));
+    EXPECT_TRUE(table.add("BlkSize", "abc"));
+    EXPECT_EQ(table.size(), 1);
+    EXPECT_FALSE(TransactionOptionValues().setOptionsFromTable(table));
+}
+
+//Test if a request with more options than the table holds is rejected instead of being cut off
+TEST(TTFTPMessages, TooManyRequestOptionsRejected)
+{
+    std::map<std::string, std::string> options;
+    for(std::size_t i = 0; i <= MAX_REQUEST_OPTIONS; ++i)
+    {
+        options["opt" + std::to_string(i)] = "1";
+    }
+    RequestMessage request;
+    request.setRRQ();
+    request.setFilename("file.bin");
+    request.setMode(TftpMode::OCTET);
+    request.setOptVals(options);
+    const std::string packet = request.encode();
+
+    TftpParsedRequest parsed;
+    EXPECT_FALSE(RequestMessage::decodeInPlace(boost::asio::buffer(packet), parsed));
+
+    options.erase(options.begin());
+    request.setOptVals(options);
+    const std::string fittingpacket = request.encode();
+    EXPECT_TRUE(RequestMessage::decodeInPlace(boost::asio::buffer(fittingpacket), parsed));
+    EXPECT_EQ(parsed.options.size(), MAX_REQUEST_OPTIONS);
+}
+
+//Test if the fields of requests are found at every position relative to the vector width, and malformed requests are rejected
+TEST(TTFTPMessages, RequestFieldsSplitAndValidated)
+{
+    for(std::size_t filenamelength = 0; filenamelength < 80; ++filenamelength)
+    {
+        RequestMessage request;
+        request.setWRQ();
+        request.setFilename(std::string(filenamelength, 'f'));
+        request.setMode(TftpMode::OCTET);
+        request.setOptVals(std::map<std::string, std::string>{{"blksize", "1428"}, {"tsize", std::string(filenamelength, '1')}});
+        const std::string packet = request.encode();
+
+        TftpParsedRequest parsed;
+        ASSERT_TRUE(RequestMessage::decodeInPlace(boost::asio::buffer(packet), parsed));
+        EXPECT_EQ(parsed.filename.size(), filenamelength);
+        EXPECT_EQ(parsed.options.find("blksize"), "1428");
+        EXPECT_EQ(parsed.options.find("tsize")->size(), filenamelength);
+
+        //Truncations leave an unterminated field or a missing value, except right behind the mode or a whole option-value pair
+        const std::size_t behindmode = OPCODELENGTH + filenamelength + 1 + std::string("octet").size() + 1;
+        const std::size_t behindblksize = behindmode + std::string("blksize").size() + 1 + std::string("1428").size() + 1;
+        for(std::size_t size = OPCODELENGTH; size < packet.size(); ++size)
+        {
+            const bool complete = size == behindmode || size == behindblksize;
+            EXPECT_EQ(RequestMessage::decodeInPlace(boost::asio::buffer(packet.data(), size), parsed), complete) << filenamelength << " " << size;
+        }
+    }
+
+    TftpParsedRequest parsed;
+    const std::string trailing("\x00\x01" "file\x00octet\x00garbage", 19);
+    EXPECT_FALSE(RequestMessage::decodeInPlace(boost::asio::buffer(trailing), parsed));
+    const std::string novalue("\x00\x01" "file\x00octet\x00" "blksize\x00", 20);
+    EXPECT_FALSE(RequestMessage::decodeInPlace(boost::asio::buffer(novalue), parsed));
+    const std::string nomode("\x00\x01" "file\x00", 7);
+    EXPECT_FALSE(RequestMessage::decodeInPlace(boost::asio::buffer(nomode), parsed));
+
+    TftpOptionTable oackoptions;
+    const std::string oack("\x00\x06" "blksize\x00" "1024\x00", 15);
+    EXPECT_TRUE(OptionACKMessage::decodeInPlace(boost::asio::buffer(oack), oackoptions));
+    EXPECT_EQ(oackoptions.find("blksize"), "1024");
+    EXPECT_FALSE(OptionACKMessage::decodeInPlace(boost::asio::buffer(oack.data(), oack.size() - 1), oackoptions));
+}
+
+//Test if the header layouts encode in network byte order at compile time, and at unaligned positions of a packet
+TEST(TTFTPMessages, HeaderLayoutsEncodeNetworkByteOrder)
+{
+    constexpr auto encodedAck = [] {
+        std::array<unsigned char, AckLayout::size> header{};
+        AckLayout::encode(header.data(), static_cast<uint16_t>(TftpOpcode::ACK), 0x1234);
+        return header;
+    }();
+    static_assert(encodedAck[0] == 0x00 && encodedAck[1] == 0x04 && encodedAck[2] == 0x12 && encodedAck[3] == 0x34);
+    static_assert(std::get<1>(AckLayout::decode(encodedAck.data())) == 0x1234);
+
+    std::array<unsigned char, 1 + ErrorHeaderLayout::size> packet{};
+    ErrorHeaderLayout::encode(packet.data() + 1, static_cast<uint16_t>(TftpOpcode::ERROR), 0xABCD);
+    const auto [opcode, errorCode] = ErrorHeaderLayout::decode(packet.data() + 1);
+    EXPECT_EQ(opcode, static_cast<uint16_t>(TftpOpcode::ERROR));
+    EXPECT_EQ(errorCode, 0xABCD);
+    EXPECT_EQ(readOpcode(packet.data() + 1), static_cast<uint16_t>(TftpOpcode::ERROR));
+    EXPECT_FALSE(ErrorHeaderLayout::fitsInto(ErrorHeaderLayout::size - 1));
+}
@@ -0,0 +1,63 @@
+#include <gmock/gmock-matchers.h>
+#include <gtest/gtest.h>
+
+#include "tftprttestimator.h"
+#include "tftphelpdefs.h"
+
+using namespace std::chrono_literals;
+
+using namespace testing;
+
+//Test if the configured timeout is used as long as there is no round trip sample
+TEST(TTFTPRttEstimator, ConfiguredTimeoutWithoutSample)
+{
+    TftpRttEstimator rtt{std::chrono::seconds(RETRANSMISSION_TIME)};
+    EXPECT_EQ(rtt.getTimeout(), std::chrono::seconds(RETRANSMISSION_TIME));
+    EXPECT_TRUE(rtt.isAtMaxTimeout());
+
+    rtt.onTimeout();
+    EXPECT_EQ(rtt.getTimeout(), std::chrono::seconds(RETRANSMISSION_TIME));
+}
+
+//Test if the timeout follows the measured round trip times, within its lower and upper bound
+TEST(TTFTPRttEstimator, TimeoutFollowsSamples)
+{
+    TftpRttEstimator rtt(2s);
+
+    rtt.addSample(10ms);
+    //SRTT + 4 * RTTVAR = 10ms + 4 * 5ms
+    EXPECT_EQ(rtt.getTimeout(), 30ms);
+    EXPECT_FALSE(rtt.isAtMaxTimeout());
+
+    for(int i = 0; i < 50; ++i)
+    {
+        rtt.addSample(1ms);
+    }
+    EXPECT_EQ(rtt.getTimeout(), std::chrono::milliseconds(MIN_RETRANSMISSION_TIME_MS));
+
+    for(int i = 0; i < 50; ++i)
+    {
+        rtt.addSample(5s);
+    }
+    EXPECT_EQ(rtt.getTimeout(), 2s);
+    EXPECT_TRUE(rtt.isAtMaxTimeout());
+}
+
+//Test if the timeout is doubled on every timeout up to the configured timeout, and a new sample ends the backoff
+TEST(TTFTPRttEstimator, ExponentialBackoff)
+{
+    TftpRttEstimator rtt(1s);
+    rtt.addSample(100ms);
+    const std::chrono::milliseconds estimate = rtt.getTimeout();
+    EXPECT_EQ(estimate, 300ms);
+
+    rtt.onTimeout();
+    EXPECT_EQ(rtt.getTimeout(), 600ms);
+    EXPECT_FALSE(rtt.isAtMaxTimeout());
+    rtt.onTimeout();
+    EXPECT_EQ(rtt.getTimeout(), 1s);
+    EXPECT_TRUE(rtt.isAtMaxTimeout());
+
+    rtt.addSample(100ms);
+    EXPECT_LT(rtt.getTimeout(), 1s);
+}
@@ -187,6 +187,118 @@ TEST(TTFTPServer, ServerStartsWRQConn)
     EXPECT_EQ(timeout,  false);
 }
 
+//test whether a server running on several threads serves concurrent read requests, each from its own port
+TEST(TTFTPServer, MultiThreadedServerServesConcurrentRRQs)
+{
+    static constexpr unsigned int NUM_OF_CLIENTS = 4;
+
+    std::string filename = "RRQMultiThreadTestFile.txt";
+    std::string mode = "octet";
+
+    std::vector<char> RRQmsg(sizeof(uint16_t));
+    *reinterpret_cast<uint16_t*>(RRQmsg.data()) = htons(static_cast<uint16_t>(TftpOpcode::RRQ));
+    RRQmsg.insert(RRQmsg.end(), filename.begin(), filename.end());
+    RRQmsg.push_back(0);
+    RRQmsg.insert(RRQmsg.end(), mode.begin(), mode.end());
+    RRQmsg.push_back(0);
+
+    std::vector<char> ofsinput;
+    for(uint16_t i = 1; i <= 512 * NUM_OF_BLOCKS; ++i)
+    {
+        ofsinput.push_back(i);
+    }
+    {
+        std::ofstream ofs(filename, std::ios_base::binary);
+        ofs.write(ofsinput.data(), ofsinput.size());
+    }
+
+    boost::asio::io_context testIoContext;
+    boost::asio::io_context clientIoContext;
+    TftpServer server(std::filesystem::absolute("./"), testIoContext, SERVER_LISTEN_PORT, DEFAULT_BLOCK_CACHE_BYTES, 4);
+    std::thread t([&server] () {server.run();});
+
+    std::vector<boost::asio::ip::udp::socket> clientsockets;
+    std::vector<std::future<std::size_t>> futures;
+    std::vector<std::array<char, 516>> buffers(NUM_OF_CLIENTS);
+    std::vector<boost::asio::ip::udp::endpoint> senderendpoints(NUM_OF_CLIENTS);
+    for(unsigned int i = 0; i < NUM_OF_CLIENTS; ++i)
+    {
+        clientsockets.emplace_back(clientIoContext, boost::asio::ip::udp::endpoint(boost::asio::ip::udp::v4(), 45050 + i));
+    }
+    for(unsigned int i = 0; i < NUM_OF_CLIENTS; ++i)
+    {
+        futures.push_back(clientsockets[i].async_receive_from(boost::asio::buffer(buffers[i]), senderendpoints[i], boost::asio::use_future));
+        clientsockets[i].send_to(boost::asio::buffer(RRQmsg), boost::asio::ip::udp::endpoint(boost::asio::ip::address_v4::loopback(), SERVER_LISTEN_PORT));
+    }
+    std::thread clientthread([&clientIoContext] () {clientIoContext.run();});
+
+    for(unsigned int i = 0; i < NUM_OF_CLIENTS; ++i)
+    {
+        EXPECT_EQ(futures[i].wait_for(15s), std::future_status::ready);
+        if(futures[i].wait_for(0s) == std::future_status::ready)
+        {
+            EXPECT_EQ(futures[i].get(), 512 + CONTROLBYTES);
+            EXPECT_EQ(ntohs(*reinterpret_cast<uint16_t*>(buffers[i].data())), static_cast<uint16_t>(TftpOpcode::DATA));
+            EXPECT_EQ(ntohs(*reinterpret_cast<uint16_t*>(buffers[i].data() + CONTROLBYTES/2)), 1);
+            EXPECT_TRUE(std::equal(buffers[i].begin() + CONTROLBYTES, buffers[i].end(), ofsinput.begin()));
+        }
+    }
+    for(unsigned int i = 1; i < NUM_OF_CLIENTS; ++i)
+    {
+        EXPECT_NE(senderendpoints[i].port(), senderendpoints[0].port());
+    }
+
+    clientIoContext.stop();
+    clientthread.join();
+    testIoContext.stop();
+    t.join();
+}
+
+//Test if a windowsize whose ACKs could not be told apart after a block number rollover is answered with the largest one that can
+TEST(TTFTPServer, LargeWindowsizeClampedInOACK)
+{
+    std::string filename = "RRQLargeWindowTestFile.txt";
+    std::string mode = "octet";
+    std::string option = "windowsize";
+    std::string value = "65535";
+
+    std::vector<char> RRQmsg(sizeof(uint16_t));
+    *reinterpret_cast<uint16_t*>(RRQmsg.data()) = htons(static_cast<uint16_t>(TftpOpcode::RRQ));
+    for(const std::string &field : {filename, mode, option, value})
+    {
+        RRQmsg.insert(RRQmsg.end(), field.begin(), field.end());
+        RRQmsg.push_back(0);
+    }
+    {
+        std::ofstream ofs(filename, std::ios_base::binary);
+        ofs << "content";
+    }
+
+    boost::asio::io_context testIoContext;
+    boost::asio::ip::udp::socket testRemoteConnSocket(testIoContext, boost::asio::ip::udp::endpoint(boost::asio::ip::udp::v4(), 45044));
+    TftpServer server(std::filesystem::absolute("./"), testIoContext);
+    std::thread t([&testIoContext] () {testIoContext.run();});
+
+    std::array<char, 512> buffer;
+    boost::asio::ip::udp::endpoint localsenderendpoint;
+    std::future<std::size_t> my_future =
+        testRemoteConnSocket.async_receive_from(boost::asio::buffer(buffer, buffer.size()), localsenderendpoint, boost::asio::use_future);
+    testRemoteConnSocket.send_to(boost::asio::buffer(RRQmsg), boost::asio::ip::udp::endpoint(boost::asio::ip::address_v4::loopback(), SERVER_LISTEN_PORT));
+
+    EXPECT_EQ(my_future.wait_for(15s), std::future_status::ready);
+    if(my_future.wait_for(0s) == std::future_status::ready)
+    {
+        const std::size_t received = my_future.get();
+        const std::string expected_option = std::string("windowsize") + '\0' + std::to_string(MAX_WINDOWSIZE) + '\0';
+        EXPECT_EQ(ntohs(*reinterpret_cast<uint16_t*>(buffer.data())), static_cast<uint16_t>(TftpOpcode::OACK));
+        EXPECT_EQ(std::string(buffer.data() + OPCODELENGTH, received - OPCODELENGTH), expected_option);
+    }
+
+    testIoContext.stop();
+    t.join();
+    std::remove(filename.c_str());
+}
+
 //TODO: test if the server correctly responds to a valid blocksize option RRQ request
 //This means that the correct OACK is sent, and that the server expects an ACK 0 before sending Data 1
 TEST(TTFTPServer, CorrectBlksizeNegotiationRRQ)
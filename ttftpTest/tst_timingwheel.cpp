@@ -0,0 +1,73 @@
+#include <gmock/gmock-matchers.h>
+#include <gtest/gtest.h>
+
+#include <vector>
+#include <boost/asio.hpp>
+#include "tftptimingwheel.h"
+
+using namespace std::chrono_literals;
+
+using namespace testing;
+
+//Test if deadlines of several transfers fire in the order of their expiry
+TEST(TTFTPTimingWheel, DeadlinesFireInOrder)
+{
+    boost::asio::io_context testIoContext;
+    std::shared_ptr<TftpTimingWheel> wheel = std::make_shared<TftpTimingWheel>(testIoContext.get_executor(), 1ms);
+
+    std::vector<int> fired;
+    TftpTransferTimer first(testIoContext.get_executor(), wheel);
+    TftpTransferTimer second(testIoContext.get_executor(), wheel);
+    TftpTransferTimer third(testIoContext.get_executor(), wheel);
+    third.expiresAfter(30ms, [&fired](boost::system::error_code err){ EXPECT_FALSE(err); fired.push_back(3); });
+    first.expiresAfter(5ms, [&fired](boost::system::error_code err){ EXPECT_FALSE(err); fired.push_back(1); });
+    second.expiresAfter(15ms, [&fired](boost::system::error_code err){ EXPECT_FALSE(err); fired.push_back(2); });
+    EXPECT_EQ(wheel->getScheduledCount(), 3);
+
+    testIoContext.run();
+
+    EXPECT_THAT(fired, ElementsAre(1, 2, 3));
+    EXPECT_EQ(wheel->getScheduledCount(), 0);
+}
+
+//Test if re-arming replaces the previous deadline and cancelling prevents the handler from being called
+TEST(TTFTPTimingWheel, RearmAndCancel)
+{
+    boost::asio::io_context testIoContext;
+    std::shared_ptr<TftpTimingWheel> wheel = std::make_shared<TftpTimingWheel>(testIoContext.get_executor(), 1ms);
+
+    int rearmedcalls = 0;
+    int cancelledcalls = 0;
+    TftpTransferTimer rearmed(testIoContext.get_executor(), wheel);
+    TftpTransferTimer cancelled(testIoContext.get_executor(), wheel);
+    const auto start = std::chrono::steady_clock::now();
+    rearmed.expiresAfter(5ms, [&rearmedcalls](boost::system::error_code){ rearmedcalls += 100; });
+    rearmed.expiresAfter(20ms, [&rearmedcalls](boost::system::error_code){ ++rearmedcalls; });
+    cancelled.expiresAfter(10ms, [&cancelledcalls](boost::system::error_code){ ++cancelledcalls; });
+    cancelled.cancel();
+    EXPECT_EQ(wheel->getScheduledCount(), 1);
+
+    testIoContext.run();
+
+    EXPECT_EQ(rearmedcalls, 1);
+    EXPECT_EQ(cancelledcalls, 0);
+    EXPECT_GE(std::chrono::steady_clock::now() - start, 20ms);
+}
+
+//Test if a deadline beyond the lowest level of the wheel fires after being moved down the levels, not before its time
+TEST(TTFTPTimingWheel, LongDeadlineCascades)
+{
+    boost::asio::io_context testIoContext;
+    std::shared_ptr<TftpTimingWheel> wheel = std::make_shared<TftpTimingWheel>(testIoContext.get_executor(), 1ms);
+
+    bool fired = false;
+    TftpTransferTimer timer(testIoContext.get_executor(), wheel);
+    const auto start = std::chrono::steady_clock::now();
+    timer.expiresAfter(600ms, [&fired](boost::system::error_code err){ EXPECT_FALSE(err); fired = true; });
+
+    testIoContext.run();
+
+    EXPECT_TRUE(fired);
+    EXPECT_GE(std::chrono::steady_clock::now() - start, 600ms);
+    EXPECT_LT(std::chrono::steady_clock::now() - start, 1000ms);
+}
@@ -1,8 +1,10 @@
 
 #include <gmock/gmock-matchers.h>
 #include <gtest/gtest.h>
+#include <atomic>
 
 #include "tftpreceiver.h"
+#include "tftpsender.h"
 #include "tftphelpdefs.h"
 
 using namespace std::chrono_literals;
@@ -1183,3 +1185,444 @@ TEST(TTFTPreceiver, ConnectioncloseAfterTimeouts)
     EXPECT_EQ(done, true);
     EXPECT_EQ(resendcount,  RETRANSMISSIONS_UNTIL_TIMEOUT + 2);
 }
+
+//Test if only the last block of a window (rfc7440) is acknowledged
+TEST(TTFTPreceiver, ACKOnlyAfterCompleteWindow)
+{
+    boost::asio::io_context testIoContext;
+    uint16_t testport = 45042;
+    boost::asio::ip::udp::endpoint testRemoteEndpoint(boost::asio::ip::udp::v4(), testport);
+    boost::asio::ip::udp::socket testRemoteConnSocket(testIoContext, testRemoteEndpoint);
+
+
+    //fill testfile
+    std::vector<char> ofsinput;
+    for(uint16_t i = 1; i <= 512 * NUM_OF_BLOCKS; ++i)
+    {
+        ofsinput.push_back(rand());
+    }
+
+    std::string testmode = "octet";
+
+    uint16_t receiverTestPort = 45043;
+    boost::asio::ip::udp::endpoint receiverEndpoint(boost::asio::ip::udp::v4(), receiverTestPort);
+    boost::asio::ip::udp::socket receiverSock(testIoContext, receiverEndpoint);
+
+    std::shared_ptr<std::ostream> ofs = std::make_shared<std::ostringstream>(std::ios_base::binary | std::ios_base::app);
+
+    constexpr uint16_t WINDOWSIZE = 4;
+    std::shared_ptr<TftpReceiver> testReceiver = std::make_shared<TftpReceiver>(std::move(receiverSock), ofs, str2mode(testmode), boost::asio::ip::make_address("127.0.0.1"), testport, dummyCallback, DEFAULT_BLOCKSIZE, std::chrono::seconds(RETRANSMISSION_TIME), WINDOWSIZE);
+    testReceiver->start();
+
+    std::thread t([&testIoContext] () {testIoContext.run();});
+
+    boost::asio::ip::udp::endpoint localsenderendpoint;
+    std::array<char, 512> buffer;
+    testRemoteConnSocket.receive_from(boost::asio::buffer(buffer, buffer.size()), localsenderendpoint); //First ACK
+
+    //send the complete first window without waiting for ACKs
+    std::array<char, 512 + CONTROLBYTES> sendbuffer;
+    for(uint16_t blockcount = 1; blockcount <= WINDOWSIZE; ++blockcount)
+    {
+        sendbuffer.fill(0);
+        *reinterpret_cast<uint16_t*>(sendbuffer.data()) = htons(static_cast<uint16_t>(TftpOpcode::DATA));
+        *reinterpret_cast<uint16_t*>(sendbuffer.data() + CONTROLBYTES/2) = htons(blockcount);
+        std::copy(ofsinput.begin() + (blockcount - 1) * 512, ofsinput.begin() + blockcount * 512, sendbuffer.begin() + CONTROLBYTES);
+        testRemoteConnSocket.send_to(boost::asio::buffer(sendbuffer, sendbuffer.size()), localsenderendpoint);
+    }
+
+    //The first answer must be the ACK for the last block of the window
+    buffer.fill(0);
+    std::future<std::size_t> my_future =
+        testRemoteConnSocket.async_receive_from(boost::asio::buffer(buffer, buffer.size()), localsenderendpoint, boost::asio::use_future);
+    auto futurestatus = my_future.wait_for(RETRANSMISSION_TIME * 2s);
+    if(futurestatus == std::future_status::timeout)
+    {
+        EXPECT_EQ(true,false);
+        testRemoteConnSocket.close();
+    }
+    else
+    {
+        bool equalControlInfo = ntohs(*reinterpret_cast<uint16_t*>(buffer.data())) == static_cast<uint16_t>(TftpOpcode::ACK);
+        bool equalACK = ntohs(*reinterpret_cast<uint16_t*>(buffer.data() + CONTROLBYTES/2)) == WINDOWSIZE;
+        EXPECT_EQ(equalControlInfo, true);
+        EXPECT_EQ(equalACK, true);
+    }
+
+    testIoContext.stop();
+    t.join();
+
+    std::string expectedOutput(ofsinput.begin(), ofsinput.begin() + WINDOWSIZE * 512);
+    EXPECT_EQ(std::static_pointer_cast<std::ostringstream>(ofs)->str(), expectedOutput);
+}
+
+//Test if a transfer with more than 65535 blocks arrives completely, for both rollover values
+TEST(TTFTPreceiver, outputFileCorrectAfterBlockRollover)
+{
+    constexpr std::size_t SMALL_BLKSIZE = 8;
+    constexpr std::size_t BLOCKS = 140000;
+    constexpr uint16_t WINDOWSIZE = 16;
+
+    std::string ofsinput;
+    for(std::size_t i = 0; i < SMALL_BLKSIZE * BLOCKS + 3; ++i)
+    {
+        ofsinput.push_back(rand());
+    }
+
+    for(uint16_t rollover : {0, 1})
+    {
+        boost::asio::io_context testIoContext;
+        std::string testmode = "octet";
+
+        uint16_t receiverTestPort = 45043;
+        boost::asio::ip::udp::endpoint receiverEndpoint(boost::asio::ip::udp::v4(), receiverTestPort);
+        boost::asio::ip::udp::socket receiverSock(testIoContext, receiverEndpoint);
+        boost::asio::ip::udp::socket senderSock(testIoContext, boost::asio::ip::udp::endpoint(boost::asio::ip::udp::v4(), 0));
+
+        std::promise<TftpUserFacingErrorCode> receiverDone;
+        std::shared_ptr<std::ostream> ofs = std::make_shared<std::ostringstream>(std::ios_base::binary | std::ios_base::app);
+        std::shared_ptr<TftpReceiver> testReceiver = std::make_shared<TftpReceiver>(std::move(receiverSock), ofs, str2mode(testmode),
+                                                                                    [&receiverDone] (std::shared_ptr<TftpReceiver>, TftpUserFacingErrorCode err) {receiverDone.set_value(err);},
+                                                                                    SMALL_BLKSIZE, std::chrono::seconds(RETRANSMISSION_TIME), WINDOWSIZE, rollover);
+        std::shared_ptr<std::istream> ifs = std::make_shared<std::istringstream>(ofsinput, std::ios_base::binary);
+        std::shared_ptr<Tftpsender> testSender = std::make_shared<Tftpsender>(std::move(senderSock), ifs, str2mode(testmode), boost::asio::ip::make_address("127.0.0.1"), receiverTestPort, 1,
+                                                                              [] (std::shared_ptr<Tftpsender>, TftpUserFacingErrorCode) {},
+                                                                              SMALL_BLKSIZE, std::chrono::seconds(RETRANSMISSION_TIME), WINDOWSIZE, rollover);
+        testReceiver->start();
+        testSender->start();
+
+        std::thread t([&testIoContext] () {testIoContext.run();});
+
+        std::future<TftpUserFacingErrorCode> done_future = receiverDone.get_future();
+        const bool finished = done_future.wait_for(60s) == std::future_status::ready;
+        EXPECT_EQ(finished, true);
+        if(finished)
+        {
+            EXPECT_EQ(done_future.get(), TftpUserFacingErrorCode::ERR_NOERR);
+        }
+
+        testIoContext.stop();
+        t.join();
+
+        EXPECT_TRUE(std::static_pointer_cast<std::ostringstream>(ofs)->str() == ofsinput);
+    }
+}
+
+//Test if the file arrives completely when the received data is written behind, with a budget small enough that the receiver has to hold back ACKs
+TEST(TTFTPreceiver, outputFileCorrectWithWriteBehind)
+{
+    constexpr std::size_t BLOCKS = 2000;
+    constexpr uint16_t WINDOWSIZE = 8;
+    constexpr std::size_t WRITEBEHIND_BYTES = 16 * 1024;
+
+    std::string ofsinput;
+    for(std::size_t i = 0; i < DEFAULT_BLOCKSIZE * BLOCKS + 100; ++i)
+    {
+        ofsinput.push_back(rand());
+    }
+
+    boost::asio::io_context testIoContext;
+    std::string testmode = "octet";
+
+    uint16_t receiverTestPort = 45043;
+    boost::asio::ip::udp::endpoint receiverEndpoint(boost::asio::ip::udp::v4(), receiverTestPort);
+    boost::asio::ip::udp::socket receiverSock(testIoContext, receiverEndpoint);
+    boost::asio::ip::udp::socket senderSock(testIoContext, boost::asio::ip::udp::endpoint(boost::asio::ip::udp::v4(), 0));
+
+    std::promise<TftpUserFacingErrorCode> receiverDone;
+    std::shared_ptr<std::ostream> ofs = std::make_shared<std::ostringstream>(std::ios_base::binary | std::ios_base::app);
+    std::shared_ptr<TftpReceiver> testReceiver = std::make_shared<TftpReceiver>(std::move(receiverSock), ofs, str2mode(testmode),
+                                                                                [&receiverDone] (std::shared_ptr<TftpReceiver>, TftpUserFacingErrorCode err) {receiverDone.set_value(err);},
+                                                                                DEFAULT_BLOCKSIZE, std::chrono::seconds(RETRANSMISSION_TIME), WINDOWSIZE, DEFAULT_ROLLOVER,
+                                                                                std::shared_ptr<TftpTimingWheel>(), std::make_shared<TftpWriteBehind>(ofs, WRITEBEHIND_BYTES));
+    std::shared_ptr<std::istream> ifs = std::make_shared<std::istringstream>(ofsinput, std::ios_base::binary);
+    std::shared_ptr<Tftpsender> testSender = std::make_shared<Tftpsender>(std::move(senderSock), ifs, str2mode(testmode), boost::asio::ip::make_address("127.0.0.1"), receiverTestPort, 1,
+                                                                          [] (std::shared_ptr<Tftpsender>, TftpUserFacingErrorCode) {},
+                                                                          DEFAULT_BLOCKSIZE, std::chrono::seconds(RETRANSMISSION_TIME), WINDOWSIZE);
+    testReceiver->start();
+    testSender->start();
+
+    std::thread t([&testIoContext] () {testIoContext.run();});
+
+    std::future<TftpUserFacingErrorCode> done_future = receiverDone.get_future();
+    const bool finished = done_future.wait_for(60s) == std::future_status::ready;
+    EXPECT_EQ(finished, true);
+    if(finished)
+    {
+        EXPECT_EQ(done_future.get(), TftpUserFacingErrorCode::ERR_NOERR);
+    }
+
+    testIoContext.stop();
+    t.join();
+
+    //All data is in the stream when the receiver reports the end of the transfer
+    EXPECT_TRUE(std::static_pointer_cast<std::ostringstream>(ofs)->str() == ofsinput);
+
+    //Both ends computed the checksum of the whole file on the way, despite resent windows
+    const uint32_t expected_checksum = TftpChecksum::compute(ofsinput.data(), ofsinput.size());
+    EXPECT_EQ(testReceiver->getChecksum(), expected_checksum);
+    EXPECT_EQ(testSender->getChecksum(), expected_checksum);
+}
+
+//Test if a datagram that is larger than the agreed blocksize is detected when a window is received in batches, although it does not fit into its slot
+TEST(TTFTPreceiver, ErrorOnOversizedBlockInWindow)
+{
+    boost::asio::io_context testIoContext;
+    uint16_t testport = 45042;
+    boost::asio::ip::udp::endpoint testRemoteEndpoint(boost::asio::ip::udp::v4(), testport);
+    boost::asio::ip::udp::socket testRemoteConnSocket(testIoContext, testRemoteEndpoint);
+
+    std::string testmode = "octet";
+
+    uint16_t receiverTestPort = 45043;
+    boost::asio::ip::udp::endpoint receiverEndpoint(boost::asio::ip::udp::v4(), receiverTestPort);
+    boost::asio::ip::udp::socket receiverSock(testIoContext, receiverEndpoint);
+
+    std::shared_ptr<std::ostream> ofs = std::make_shared<std::ostringstream>(std::ios_base::binary | std::ios_base::app);
+
+    constexpr uint16_t WINDOWSIZE = 4;
+    std::shared_ptr<TftpReceiver> testReceiver = std::make_shared<TftpReceiver>(std::move(receiverSock), ofs, str2mode(testmode), boost::asio::ip::make_address("127.0.0.1"), testport, dummyCallback, DEFAULT_BLOCKSIZE, std::chrono::seconds(RETRANSMISSION_TIME), WINDOWSIZE);
+    testReceiver->start();
+
+    std::thread t([&testIoContext] () {testIoContext.run();});
+
+    boost::asio::ip::udp::endpoint localsenderendpoint;
+    std::array<char, 512> buffer;
+    testRemoteConnSocket.receive_from(boost::asio::buffer(buffer, buffer.size()), localsenderendpoint); //First ACK
+
+    //Block 1 is fine, block 2 carries more payload than the blocksize
+    std::array<char, 512 + 10 + CONTROLBYTES> sendbuffer;
+    for(uint16_t blockcount = 1; blockcount <= 2; ++blockcount)
+    {
+        sendbuffer.fill(0);
+        *reinterpret_cast<uint16_t*>(sendbuffer.data()) = htons(static_cast<uint16_t>(TftpOpcode::DATA));
+        *reinterpret_cast<uint16_t*>(sendbuffer.data() + CONTROLBYTES/2) = htons(blockcount);
+        const std::size_t size = blockcount == 1 ? 512 + CONTROLBYTES : sendbuffer.size();
+        testRemoteConnSocket.send_to(boost::asio::buffer(sendbuffer, size), localsenderendpoint);
+    }
+
+    buffer.fill(0);
+    std::future<std::size_t> my_future =
+        testRemoteConnSocket.async_receive_from(boost::asio::buffer(buffer, buffer.size()), localsenderendpoint, boost::asio::use_future);
+    auto futurestatus = my_future.wait_for(RETRANSMISSION_TIME * 2s);
+    if(futurestatus == std::future_status::timeout)
+    {
+        EXPECT_EQ(true,false);
+        testRemoteConnSocket.close();
+    }
+    else
+    {
+        EXPECT_EQ(ntohs(*reinterpret_cast<uint16_t*>(buffer.data())), static_cast<uint16_t>(TftpOpcode::ERROR));
+        EXPECT_EQ(ntohs(*reinterpret_cast<uint16_t*>(buffer.data() + OPCODELENGTH)), static_cast<uint16_t>(TftpErrorCode::ERR_ILLEGAL_OP));
+    }
+
+    testIoContext.stop();
+    t.join();
+}
+
+//Test if the blocks of a window that arrive out of order are written in order, and the window is still acknowledged only once
+TEST(TTFTPreceiver, ReorderedWindowWrittenInOrder)
+{
+    boost::asio::io_context testIoContext;
+    uint16_t testport = 45042;
+    boost::asio::ip::udp::endpoint testRemoteEndpoint(boost::asio::ip::udp::v4(), testport);
+    boost::asio::ip::udp::socket testRemoteConnSocket(testIoContext, testRemoteEndpoint);
+
+    std::vector<char> ofsinput;
+    for(uint16_t i = 1; i <= 512 * NUM_OF_BLOCKS; ++i)
+    {
+        ofsinput.push_back(rand());
+    }
+
+    std::string testmode = "octet";
+
+    uint16_t receiverTestPort = 45043;
+    boost::asio::ip::udp::endpoint receiverEndpoint(boost::asio::ip::udp::v4(), receiverTestPort);
+    boost::asio::ip::udp::socket receiverSock(testIoContext, receiverEndpoint);
+
+    std::shared_ptr<std::ostream> ofs = std::make_shared<std::ostringstream>(std::ios_base::binary | std::ios_base::app);
+
+    constexpr uint16_t WINDOWSIZE = 4;
+    std::shared_ptr<TftpReceiver> testReceiver = std::make_shared<TftpReceiver>(std::move(receiverSock), ofs, str2mode(testmode), boost::asio::ip::make_address("127.0.0.1"), testport, dummyCallback, DEFAULT_BLOCKSIZE, std::chrono::seconds(RETRANSMISSION_TIME), WINDOWSIZE);
+    testReceiver->start();
+
+    std::thread t([&testIoContext] () {testIoContext.run();});
+
+    boost::asio::ip::udp::endpoint localsenderendpoint;
+    std::array<char, 512> buffer;
+    testRemoteConnSocket.receive_from(boost::asio::buffer(buffer, buffer.size()), localsenderendpoint); //First ACK
+
+    //Block 3 overtakes block 2
+    std::array<char, 512 + CONTROLBYTES> sendbuffer;
+    for(uint16_t blockcount : {1, 3, 2, 4})
+    {
+        *reinterpret_cast<uint16_t*>(sendbuffer.data()) = htons(static_cast<uint16_t>(TftpOpcode::DATA));
+        *reinterpret_cast<uint16_t*>(sendbuffer.data() + CONTROLBYTES/2) = htons(blockcount);
+        std::copy(ofsinput.begin() + (blockcount - 1) * 512, ofsinput.begin() + blockcount * 512, sendbuffer.begin() + CONTROLBYTES);
+        testRemoteConnSocket.send_to(boost::asio::buffer(sendbuffer, sendbuffer.size()), localsenderendpoint);
+    }
+
+    buffer.fill(0);
+    std::future<std::size_t> my_future =
+        testRemoteConnSocket.async_receive_from(boost::asio::buffer(buffer, buffer.size()), localsenderendpoint, boost::asio::use_future);
+    auto futurestatus = my_future.wait_for(RETRANSMISSION_TIME * 1s);
+    if(futurestatus == std::future_status::timeout)
+    {
+        EXPECT_EQ(true,false);
+        testRemoteConnSocket.close();
+    }
+    else
+    {
+        EXPECT_EQ(ntohs(*reinterpret_cast<uint16_t*>(buffer.data())), static_cast<uint16_t>(TftpOpcode::ACK));
+        EXPECT_EQ(ntohs(*reinterpret_cast<uint16_t*>(buffer.data() + CONTROLBYTES/2)), WINDOWSIZE);
+    }
+
+    testIoContext.stop();
+    t.join();
+
+    std::string expectedOutput(ofsinput.begin(), ofsinput.begin() + WINDOWSIZE * 512);
+    EXPECT_EQ(std::static_pointer_cast<std::ostringstream>(ofs)->str(), expectedOutput);
+}
+
+//Test if the blocks after a lost block are acknowledged as soon as the lost block arrives again, so the windows of a go-back-N sender stay in step with the receiver's ACKs
+TEST(TTFTPreceiver, HeldBlocksWrittenAfterLostBlock)
+{
+    boost::asio::io_context testIoContext;
+    uint16_t testport = 45042;
+    boost::asio::ip::udp::endpoint testRemoteEndpoint(boost::asio::ip::udp::v4(), testport);
+    boost::asio::ip::udp::socket testRemoteConnSocket(testIoContext, testRemoteEndpoint);
+
+    constexpr std::size_t LASTBLOCKSIZE = 100;
+    std::vector<char> ofsinput;
+    for(std::size_t i = 0; i < 512 * 12 + LASTBLOCKSIZE; ++i)
+    {
+        ofsinput.push_back(rand());
+    }
+    constexpr uint16_t LASTBLOCK = 13;
+
+    std::string testmode = "octet";
+
+    uint16_t receiverTestPort = 45043;
+    boost::asio::ip::udp::endpoint receiverEndpoint(boost::asio::ip::udp::v4(), receiverTestPort);
+    boost::asio::ip::udp::socket receiverSock(testIoContext, receiverEndpoint);
+
+    std::shared_ptr<std::ostream> ofs = std::make_shared<std::ostringstream>(std::ios_base::binary | std::ios_base::app);
+
+    constexpr uint16_t WINDOWSIZE = 4;
+    std::shared_ptr<TftpReceiver> testReceiver = std::make_shared<TftpReceiver>(std::move(receiverSock), ofs, str2mode(testmode), boost::asio::ip::make_address("127.0.0.1"), testport, dummyCallback, DEFAULT_BLOCKSIZE, std::chrono::seconds(RETRANSMISSION_TIME), WINDOWSIZE);
+    testReceiver->start();
+
+    std::thread t([&testIoContext] () {testIoContext.run();});
+
+    boost::asio::ip::udp::endpoint localsenderendpoint;
+    std::array<char, 512> buffer;
+    testRemoteConnSocket.receive_from(boost::asio::buffer(buffer, buffer.size()), localsenderendpoint); //First ACK
+
+    std::array<char, 512 + CONTROLBYTES> sendbuffer;
+    auto sendBlock = [&] (uint16_t blockcount)
+    {
+        const std::size_t begin = (blockcount - 1) * 512;
+        const std::size_t end = std::min(ofsinput.size(), begin + 512);
+        *reinterpret_cast<uint16_t*>(sendbuffer.data()) = htons(static_cast<uint16_t>(TftpOpcode::DATA));
+        *reinterpret_cast<uint16_t*>(sendbuffer.data() + CONTROLBYTES/2) = htons(blockcount);
+        std::copy(ofsinput.begin() + begin, ofsinput.begin() + end, sendbuffer.begin() + CONTROLBYTES);
+        testRemoteConnSocket.send_to(boost::asio::buffer(sendbuffer, CONTROLBYTES + end - begin), localsenderendpoint);
+    };
+    auto receiveAck = [&] () -> int
+    {
+        buffer.fill(0);
+        std::future<std::size_t> my_future =
+            testRemoteConnSocket.async_receive_from(boost::asio::buffer(buffer, buffer.size()), localsenderendpoint, boost::asio::use_future);
+        if(my_future.wait_for(RETRANSMISSION_TIME * 1s) == std::future_status::timeout
+           || ntohs(*reinterpret_cast<uint16_t*>(buffer.data())) != static_cast<uint16_t>(TftpOpcode::ACK))
+        {
+            return -1;
+        }
+        return ntohs(*reinterpret_cast<uint16_t*>(buffer.data() + CONTROLBYTES/2));
+    };
+
+    //Block 2 gets lost: once the window is through, the receiver asks for the window after block 1
+    for(uint16_t blockcount : {1, 3, 4})
+    {
+        sendBlock(blockcount);
+    }
+    std::vector<int> acks{receiveAck()};
+
+    //Like a go-back-N sender, the window after each ACK is sent again completely. The duplicates of blocks 3 to 5 must not be answered
+    while(acks.back() > 0 && acks.back() < LASTBLOCK)
+    {
+        for(int blockcount = acks.back() + 1; blockcount <= std::min<int>(acks.back() + WINDOWSIZE, LASTBLOCK); ++blockcount)
+        {
+            sendBlock(blockcount);
+        }
+        acks.push_back(receiveAck());
+    }
+    EXPECT_EQ(acks, std::vector<int>({1, 4, 8, 12, 13}));
+
+    testIoContext.stop();
+    t.join();
+
+    std::string expectedOutput(ofsinput.begin(), ofsinput.end());
+    EXPECT_EQ(std::static_pointer_cast<std::ostringstream>(ofs)->str(), expectedOutput);
+}
+
+//Test if the final ACK is sent again when the last block is retransmitted after the transfer finished, and the receiver lets go afterwards
+TEST(TTFTPreceiver, FinalACKResentWhileDallying)
+{
+    boost::asio::io_context testIoContext;
+    uint16_t testport = 45042;
+    boost::asio::ip::udp::endpoint testRemoteEndpoint(boost::asio::ip::udp::v4(), testport);
+    boost::asio::ip::udp::socket testRemoteConnSocket(testIoContext, testRemoteEndpoint);
+
+    std::string testmode = "octet";
+
+    uint16_t receiverTestPort = 45043;
+    boost::asio::ip::udp::endpoint receiverEndpoint(boost::asio::ip::udp::v4(), receiverTestPort);
+    boost::asio::ip::udp::socket receiverSock(testIoContext, receiverEndpoint);
+
+    std::shared_ptr<std::ostream> ofs = std::make_shared<std::ostringstream>(std::ios_base::binary | std::ios_base::app);
+
+    std::atomic<bool> transferDone{false};
+    std::shared_ptr<TftpReceiver> testReceiver = std::make_shared<TftpReceiver>(std::move(receiverSock), ofs, str2mode(testmode), boost::asio::ip::make_address("127.0.0.1"), testport,
+                                                                                [&transferDone] (std::shared_ptr<TftpReceiver>, TftpUserFacingErrorCode err)
+                                                                                {
+                                                                                    transferDone = err == TftpUserFacingErrorCode::ERR_NOERR;
+                                                                                },
+                                                                                DEFAULT_BLOCKSIZE, std::chrono::milliseconds(200));
+    testReceiver->start();
+    std::weak_ptr<TftpReceiver> weakReceiver = testReceiver;
+    testReceiver.reset();
+
+    std::thread t([&testIoContext] () {testIoContext.run();});
+
+    boost::asio::ip::udp::endpoint localsenderendpoint;
+    std::array<char, 512> buffer;
+    testRemoteConnSocket.receive_from(boost::asio::buffer(buffer, buffer.size()), localsenderendpoint); //First ACK
+
+    std::array<char, 100 + CONTROLBYTES> sendbuffer;
+    sendbuffer.fill(0);
+    *reinterpret_cast<uint16_t*>(sendbuffer.data()) = htons(static_cast<uint16_t>(TftpOpcode::DATA));
+    *reinterpret_cast<uint16_t*>(sendbuffer.data() + CONTROLBYTES/2) = htons(1);
+
+    //The final ACK is sent once for the block, and again for its retransmission
+    for(int attempt = 0; attempt < 2; ++attempt)
+    {
+        testRemoteConnSocket.send_to(boost::asio::buffer(sendbuffer, sendbuffer.size()), localsenderendpoint);
+        buffer.fill(0);
+        std::future<std::size_t> my_future =
+            testRemoteConnSocket.async_receive_from(boost::asio::buffer(buffer, buffer.size()), localsenderendpoint, boost::asio::use_future);
+        if(my_future.wait_for(RETRANSMISSION_TIME * 1s) == std::future_status::timeout)
+        {
+            EXPECT_EQ(true,false);
+            break;
+        }
+        EXPECT_EQ(ntohs(*reinterpret_cast<uint16_t*>(buffer.data())), static_cast<uint16_t>(TftpOpcode::ACK));
+        EXPECT_EQ(ntohs(*reinterpret_cast<uint16_t*>(buffer.data() + CONTROLBYTES/2)), 1);
+        EXPECT_EQ(transferDone.load(), true);
+    }
+
+    //The io_context runs out of work once the dally time is over
+    testRemoteConnSocket.close();
+    t.join();
+    EXPECT_EQ(weakReceiver.expired(), true);
+}
@@ -3,6 +3,7 @@
 #include <gtest/gtest.h>
 
 #include "tftpsender.h"
+#include "tftpreceiver.h"
 #include "tftphelpdefs.h"
 #include <iostream>
 
@@ -1045,8 +1046,8 @@ TEST(TTFTPSender, ConnectioncloseAfterMultipleTimeouts)
     EXPECT_EQ(resendcount, RETRANSMISSIONS_UNTIL_TIMEOUT + 2);
 }
 
-//Test if TftpSender resends correct data message when receiving ACK that is too low
-TEST(TTFTPSender, ResendWhenSmallerACK)
+//Test if ACKs for an older block do not make the sender resend (Sorcerer's Apprentice): the block is only sent again after the timeout
+TEST(TTFTPSender, NoResendOnDuplicateACK)
 {
     boost::asio::io_context testIoContext;
     uint16_t testport = 45042;
@@ -1061,71 +1062,119 @@ TEST(TTFTPSender, ResendWhenSmallerACK)
         ofsinput.push_back(i);
     }
 
-    std::ostringstream ofs(std::ios_base::binary | std::ios_base::app);
-    ofs.seekp(0);
-    ofs.write(ofsinput.data(), ofsinput.size());
-
     std::string testmode = "octet";
 
     uint16_t senderTestPort = 45043;
     boost::asio::ip::udp::endpoint senderEndpoint(boost::asio::ip::udp::v4(), senderTestPort);
     boost::asio::ip::udp::socket senderSock(testIoContext, senderEndpoint);
 
-    std::shared_ptr<std::istream> ifs = std::make_shared<std::istringstream>(ofs.str(), std::ios_base::binary);
+    std::shared_ptr<std::istream> ifs = std::make_shared<std::istringstream>(std::string(ofsinput.begin(), ofsinput.end()), std::ios_base::binary);
 
     constexpr int EXPECTED_FIRST_ACK = 1; //server, so we expect ack 0 from client
-    std::shared_ptr<Tftpsender> testSender = std::make_shared<Tftpsender>(std::move(senderSock), ifs, str2mode(testmode), boost::asio::ip::make_address("127.0.0.1"), testport, EXPECTED_FIRST_ACK, dummyCallback);
+    constexpr auto TIMEOUT = 300ms;
+    std::shared_ptr<Tftpsender> testSender = std::make_shared<Tftpsender>(std::move(senderSock), ifs, str2mode(testmode), boost::asio::ip::make_address("127.0.0.1"), testport, EXPECTED_FIRST_ACK, dummyCallback, BLKSIZE, TIMEOUT);
 
     //Ignore Ack 0
     testSender->start();
     std::thread t([&testIoContext] () {testIoContext.run();});
 
     std::array<char, BLKSIZE * 2> buffer;
-    buffer.fill(0);
     boost::asio::ip::udp::endpoint localsenderendpoint;
+    testRemoteConnSocket.receive_from(boost::asio::buffer(buffer, buffer.size()), localsenderendpoint); //DATA 1
+    const auto firstsent = std::chrono::steady_clock::now();
 
-    bool done = false;
-    unsigned int count = 1;
-    unsigned int resendcount = 0;
-    while(!done)
+    //Every duplicate of DATA 1 would be answered with ACK 0 by an rfc1350 receiver
+    constexpr int DUPLICATE_ACKS = 3;
+    std::string ackresponse;
+    ackresponse.resize(4);
+    *reinterpret_cast<uint16_t*>(const_cast<char*>(ackresponse.data())) = htons(static_cast<uint16_t>(TftpOpcode::ACK));
+    *reinterpret_cast<uint16_t*>(const_cast<char*>(ackresponse.data() + 2)) = htons(static_cast<uint16_t>(0));
+    for(int ackcount = 0; ackcount < DUPLICATE_ACKS; ++ackcount)
     {
-        //Easiest way seems to be to use an async wait with a future, and to call wait on that future: that timeout can then be used to say "connection was closed"
-        std::future<std::size_t> my_future =
-            testRemoteConnSocket.async_receive_from(boost::asio::buffer(buffer, buffer.size()), localsenderendpoint, boost::asio::use_future);
-        auto futurestatus = my_future.wait_for(200ms);
-        if(futurestatus == std::future_status::timeout)
-        {
-            done = true;
-            testRemoteConnSocket.close();
-        }
-        else
-        {
-            resendcount++;
-            std::string ackresponse;
-            ackresponse.resize(4);
-            *reinterpret_cast<uint16_t*>(const_cast<char*>(ackresponse.data())) = htons(static_cast<uint16_t>(TftpOpcode::ACK));
-            *reinterpret_cast<uint16_t*>(const_cast<char*>(ackresponse.data() + 2)) = htons(static_cast<uint16_t>(0));
-            testRemoteConnSocket.send_to(boost::asio::buffer(ackresponse, ackresponse.size()), localsenderendpoint);
+        testRemoteConnSocket.send_to(boost::asio::buffer(ackresponse, ackresponse.size()), localsenderendpoint);
+    }
 
-            //test if this current buffer is correct
-            bool equaldata = std::equal(ofsinput.begin() + (512 * (count - 1) ), ofsinput.end() - (512 * (NUM_OF_BLOCKS - (count - 1) ) ), buffer.begin() + CONTROLBYTES);
-            bool equalControlInfo = ntohs(*reinterpret_cast<uint16_t*>(buffer.data())) == static_cast<uint16_t>(TftpOpcode::DATA) && ntohs(*reinterpret_cast<uint16_t*>(buffer.data() + CONTROLBYTES/2)) == count;
-            EXPECT_EQ(equalControlInfo, true);
-            EXPECT_EQ(equaldata, true);
-            if(count == NUM_OF_BLOCKS)
-            {
-                buffer.fill(0);
-            }
-            if(resendcount > 2)
-            {
-                done = true;
-            }
-        }
+    //The next datagram is the resend of DATA 1 by the timeout, not one per ACK
+    buffer.fill(0);
+    std::future<std::size_t> my_future =
+        testRemoteConnSocket.async_receive_from(boost::asio::buffer(buffer, buffer.size()), localsenderendpoint, boost::asio::use_future);
+    if(my_future.wait_for(TIMEOUT * 4) == std::future_status::timeout)
+    {
+        EXPECT_EQ(true, false);
+        testRemoteConnSocket.close();
+    }
+    else
+    {
+        EXPECT_GE(std::chrono::steady_clock::now() - firstsent, TIMEOUT - 50ms);
+        EXPECT_EQ(ntohs(*reinterpret_cast<uint16_t*>(buffer.data() + CONTROLBYTES/2)), 1);
     }
     testIoContext.stop(); //further transfer not relevant
     t.join();
 
-    EXPECT_EQ(count,  1); //Expect last "data" block to be empty
+    EXPECT_EQ(testSender->getSuppressedDuplicateAcks(), DUPLICATE_ACKS);
+}
+
+//Test if the ACK 0 that starts a transfer is not taken as a round trip time sample, so a lost block is resent after the timeout adapted to the measured round trip times
+TEST(TTFTPSender, RoundTripTimeNotSampledFromFirstAck)
+{
+    boost::asio::io_context testIoContext;
+    uint16_t testport = 45042;
+    boost::asio::ip::udp::endpoint testRemoteEndpoint(boost::asio::ip::udp::v4(), testport);
+    boost::asio::ip::udp::socket testRemoteConnSocket(testIoContext, testRemoteEndpoint);
+
+
+    //fill testfile
+    std::vector<char> ofsinput;
+    for(uint16_t i = 1; i <= BLKSIZE * NUM_OF_BLOCKS; ++i)
+    {
+        ofsinput.push_back(i);
+    }
+
+    std::string testmode = "octet";
+
+    uint16_t senderTestPort = 45043;
+    boost::asio::ip::udp::endpoint senderEndpoint(boost::asio::ip::udp::v4(), senderTestPort);
+    boost::asio::ip::udp::socket senderSock(testIoContext, senderEndpoint);
+
+    std::shared_ptr<std::istream> ifs = std::make_shared<std::istringstream>(std::string(ofsinput.begin(), ofsinput.end()), std::ios_base::binary);
+
+    constexpr int EXPECTED_FIRST_ACK = 0; //server that sent an OACK, so the transfer starts with ACK 0
+    std::shared_ptr<Tftpsender> testSender = std::make_shared<Tftpsender>(std::move(senderSock), ifs, str2mode(testmode), boost::asio::ip::make_address("127.0.0.1"), testport, EXPECTED_FIRST_ACK, dummyCallback);
+    testSender->start();
+    std::thread t([&testIoContext] () {testIoContext.run();});
+
+    boost::asio::ip::udp::endpoint localsenderendpoint(boost::asio::ip::make_address("127.0.0.1"), senderTestPort);
+    auto sendAck = [&] (uint16_t blockcount)
+    {
+        std::array<char, 4> ackresponse;
+        *reinterpret_cast<uint16_t*>(ackresponse.data()) = htons(static_cast<uint16_t>(TftpOpcode::ACK));
+        *reinterpret_cast<uint16_t*>(ackresponse.data() + 2) = htons(blockcount);
+        testRemoteConnSocket.send_to(boost::asio::buffer(ackresponse, ackresponse.size()), localsenderendpoint);
+    };
+
+    std::array<char, BLKSIZE * 2> buffer;
+    sendAck(0);
+    testRemoteConnSocket.receive_from(boost::asio::buffer(buffer, buffer.size()), localsenderendpoint); //DATA 1
+    sendAck(1);
+    testRemoteConnSocket.receive_from(boost::asio::buffer(buffer, buffer.size()), localsenderendpoint); //DATA 2, gets lost
+    const auto lostsent = std::chrono::steady_clock::now();
+
+    //The round trip time on loopback is far below the negotiated timeout, which is only used until the first sample
+    buffer.fill(0);
+    std::future<std::size_t> my_future =
+        testRemoteConnSocket.async_receive_from(boost::asio::buffer(buffer, buffer.size()), localsenderendpoint, boost::asio::use_future);
+    if(my_future.wait_for(RETRANSMISSION_TIME * 2s) == std::future_status::timeout)
+    {
+        EXPECT_EQ(true, false);
+        testRemoteConnSocket.close();
+    }
+    else
+    {
+        EXPECT_LT(std::chrono::steady_clock::now() - lostsent, RETRANSMISSION_TIME * 1s / 2);
+        EXPECT_EQ(ntohs(*reinterpret_cast<uint16_t*>(buffer.data() + CONTROLBYTES/2)), 2);
+    }
+    testIoContext.stop(); //further transfer not relevant
+    t.join();
 }
 
 //Test if TftpSender sends correct error message when receiving ACK that is too high
@@ -1159,6 +1208,8 @@ TEST(TTFTPSender, ErrorWhenLargerACK)
     constexpr int EXPECTED_FIRST_ACK = 1; //server, so we expect ack 0 from client
     std::shared_ptr<Tftpsender> testSender = std::make_shared<Tftpsender>(std::move(senderSock), ifs, str2mode(testmode), boost::asio::ip::make_address("127.0.0.1"), testport, EXPECTED_FIRST_ACK, dummyCallback);
 
+    //The sender has no more work after it sent the error message; keep the context running for the receives of the test
+    auto work = boost::asio::make_work_guard(testIoContext);
     testSender->start();
     std::thread t([&testIoContext] () {testIoContext.run();});
 
@@ -1218,3 +1269,147 @@ TEST(TTFTPSender, ErrorWhenLargerACK)
     t.join();
     EXPECT_EQ(timeout, false);
 }
+
+//Test if TftpSender sends a complete window (rfc7440) before waiting for an ACK, and continues after the ACK for the last block of the window
+TEST(TTFTPSender, CompleteWindowSentBeforeACK)
+{
+    boost::asio::io_context testIoContext;
+    uint16_t testport = 45042;
+    boost::asio::ip::udp::endpoint testRemoteEndpoint(boost::asio::ip::udp::v4(), testport);
+    boost::asio::ip::udp::socket testRemoteConnSocket(testIoContext, testRemoteEndpoint);
+
+    //fill testfile
+    std::vector<char> ofsinput;
+    for(uint16_t i = 1; i <= BLKSIZE * NUM_OF_BLOCKS; ++i)
+    {
+        ofsinput.push_back(i);
+    }
+
+    std::ostringstream ofs(std::ios_base::binary | std::ios_base::app);
+    ofs.seekp(0);
+    ofs.write(ofsinput.data(), ofsinput.size());
+
+    std::string testmode = "octet";
+
+    uint16_t senderTestPort = 45043;
+    boost::asio::ip::udp::endpoint senderEndpoint(boost::asio::ip::udp::v4(), senderTestPort);
+    boost::asio::ip::udp::socket senderSock(testIoContext, senderEndpoint);
+
+    std::shared_ptr<std::istream> ifs = std::make_shared<std::istringstream>(ofs.str(), std::ios_base::binary);
+
+    constexpr int EXPECTED_FIRST_ACK = 1;
+    constexpr uint16_t WINDOWSIZE = 4;
+    std::shared_ptr<Tftpsender> testSender = std::make_shared<Tftpsender>(std::move(senderSock), ifs, str2mode(testmode), boost::asio::ip::make_address("127.0.0.1"), testport, EXPECTED_FIRST_ACK, dummyCallback, BLKSIZE, std::chrono::seconds(RETRANSMISSION_TIME), WINDOWSIZE);
+    testSender->start();
+    std::thread t([&testIoContext] () {testIoContext.run();});
+
+    std::array<char, BLKSIZE * 2> buffer;
+    boost::asio::ip::udp::endpoint localsenderendpoint;
+
+    bool done = false;
+    unsigned int count = 0;
+    while(!done)
+    {
+        buffer.fill(0);
+        //Easiest way seems to be to use an async wait with a future, and to call wait on that future: that timeout can then be used to say "connection was closed"
+        std::future<std::size_t> my_future =
+            testRemoteConnSocket.async_receive_from(boost::asio::buffer(buffer, buffer.size()), localsenderendpoint, boost::asio::use_future);
+        auto futurestatus = my_future.wait_for(1s);
+        if(futurestatus == std::future_status::timeout)
+        {
+            done = true;
+            testRemoteConnSocket.close();
+        }
+        else
+        {
+            count++;
+            bool equalControlInfo = ntohs(*reinterpret_cast<uint16_t*>(buffer.data())) == static_cast<uint16_t>(TftpOpcode::DATA) && ntohs(*reinterpret_cast<uint16_t*>(buffer.data() + CONTROLBYTES/2)) == count;
+            EXPECT_EQ(equalControlInfo, true);
+            if(count <= NUM_OF_BLOCKS)
+            {
+                bool equaldata = std::equal(ofsinput.begin() + (BLKSIZE * (count - 1)), ofsinput.begin() + (BLKSIZE * count), buffer.begin() + CONTROLBYTES);
+                EXPECT_EQ(equaldata, true);
+            }
+
+            //Only ACK the last block of each window, and the (empty) last block of the file
+            if(count % WINDOWSIZE == 0 || count == NUM_OF_BLOCKS + 1)
+            {
+                std::string ackresponse;
+                ackresponse.resize(4);
+                *reinterpret_cast<uint16_t*>(const_cast<char*>(ackresponse.data())) = htons(static_cast<uint16_t>(TftpOpcode::ACK));
+                *reinterpret_cast<uint16_t*>(const_cast<char*>(ackresponse.data() + 2)) = htons(static_cast<uint16_t>(count));
+                testRemoteConnSocket.send_to(boost::asio::buffer(ackresponse, ackresponse.size()), localsenderendpoint);
+            }
+            if(count == NUM_OF_BLOCKS + 1)
+            {
+                done = true;
+            }
+        }
+    }
+    t.join();
+
+    EXPECT_EQ(count,  NUM_OF_BLOCKS + 1); //Expect last "data" block to be empty
+}
+
+//Test if the ACK for the last block of the largest window is unwrapped correctly once the block numbers rolled over, for both rollover values
+TEST(TTFTPSender, LargeWindowAckUnwrappedAfterRollover)
+{
+    for(uint16_t rollover : {0, 1})
+    {
+        for(block_count_t windowbegin : {block_count_t{100000}, block_count_t{65535}, block_count_t{200000}})
+        {
+            const block_count_t lastblock = windowbegin + MAX_WINDOWSIZE - 1;
+            EXPECT_EQ(unwrapBlockNr(wireBlockNr(lastblock, rollover), windowbegin, rollover), lastblock);
+            //The receiver's report of a gap right at the start of the window
+            EXPECT_EQ(unwrapBlockNr(wireBlockNr(windowbegin - 1, rollover), windowbegin, rollover), windowbegin - 1);
+        }
+    }
+}
+
+//Test if a window that is larger than the block source can hold at once is sent in parts, and every block still arrives intact
+TEST(TTFTPSender, WindowLargerThanBlockSourceSentCorrectly)
+{
+    constexpr std::size_t SMALL_BLKSIZE = 64;
+    constexpr std::size_t BLOCKS = 500;
+    constexpr uint16_t WINDOWSIZE = 16;
+    constexpr std::size_t RINGBLOCKS = 3;
+
+    std::string ofsinput;
+    for(std::size_t i = 0; i < SMALL_BLKSIZE * BLOCKS + 5; ++i)
+    {
+        ofsinput.push_back(rand());
+    }
+
+    boost::asio::io_context testIoContext;
+    std::string testmode = "octet";
+
+    uint16_t receiverTestPort = 45043;
+    boost::asio::ip::udp::socket receiverSock(testIoContext, boost::asio::ip::udp::endpoint(boost::asio::ip::udp::v4(), receiverTestPort));
+    boost::asio::ip::udp::socket senderSock(testIoContext, boost::asio::ip::udp::endpoint(boost::asio::ip::udp::v4(), 0));
+
+    std::promise<TftpUserFacingErrorCode> receiverDone;
+    std::shared_ptr<std::ostream> ofs = std::make_shared<std::ostringstream>(std::ios_base::binary | std::ios_base::app);
+    std::shared_ptr<TftpReceiver> testReceiver = std::make_shared<TftpReceiver>(std::move(receiverSock), ofs, str2mode(testmode),
+                                                                                [&receiverDone] (std::shared_ptr<TftpReceiver>, TftpUserFacingErrorCode err) {receiverDone.set_value(err);},
+                                                                                SMALL_BLKSIZE, std::chrono::seconds(RETRANSMISSION_TIME), WINDOWSIZE);
+    std::shared_ptr<ITftpBlockSource> blocksource = std::make_shared<TftpStreamBlockSource>(std::make_shared<std::istringstream>(ofsinput, std::ios_base::binary), SMALL_BLKSIZE, RINGBLOCKS);
+    std::shared_ptr<Tftpsender> testSender = std::make_shared<Tftpsender>(std::move(senderSock), blocksource, str2mode(testmode), boost::asio::ip::make_address("127.0.0.1"), receiverTestPort, 1,
+                                                                          dummyCallback, SMALL_BLKSIZE, std::chrono::seconds(RETRANSMISSION_TIME), WINDOWSIZE);
+    testReceiver->start();
+    testSender->start();
+
+    std::thread t([&testIoContext] () {testIoContext.run();});
+
+    std::future<TftpUserFacingErrorCode> done_future = receiverDone.get_future();
+    const bool finished = done_future.wait_for(30s) == std::future_status::ready;
+    EXPECT_EQ(finished, true);
+    if(finished)
+    {
+        EXPECT_EQ(done_future.get(), TftpUserFacingErrorCode::ERR_NOERR);
+    }
+
+    testIoContext.stop();
+    t.join();
+
+    EXPECT_TRUE(std::static_pointer_cast<std::ostringstream>(ofs)->str() == ofsinput);
+}
@@ -0,0 +1,140 @@
+#include <gmock/gmock-matchers.h>
+#include <gtest/gtest.h>
+
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "tftpwritebehind.h"
+
+using namespace testing;
+
+//Writes into a file with space reserved beyond its end and checks that the data lands behind the existing content, and the size only grows by the written data (the reservation keeps the size, its unused part is released without truncating)
+static void checkPreallocatedFile(const std::string &filename, const std::string &existing, std::shared_ptr<ITftpFileIo> fileio, bool directio = false)
+{
+    std::remove(filename.c_str());
+    {
+        std::ofstream ofs(filename, std::ios_base::binary);
+        ofs << existing;
+    }
+
+    std::string input;
+    for(std::size_t i = 0; i < 700 * 1024 + 17; ++i)
+    {
+        input.push_back(rand());
+    }
+
+    std::error_code ec;
+    std::shared_ptr<TftpWriteBehind> writebehind = TftpWriteBehind::openPreallocated(filename, 1024 * 1024, 64 * 1024, ec, fileio, directio);
+    ASSERT_TRUE(writebehind);
+    EXPECT_TRUE(writebehind->isOpen());
+    //The space is reserved, but the file only grows with the data that is written
+    EXPECT_EQ(std::filesystem::file_size(filename), existing.size());
+
+    for(std::size_t pos = 0; pos < input.size(); pos += DEFAULT_BLOCKSIZE)
+    {
+        writebehind->append(input.data() + pos, std::min(DEFAULT_BLOCKSIZE, input.size() - pos));
+    }
+
+    //The writes run on the writer pool, the context has to wait for the flush to come back
+    boost::asio::io_context testIoContext;
+    auto work = boost::asio::make_work_guard(testIoContext);
+    bool flushed = false;
+    writebehind->flush(testIoContext.get_executor(), [&flushed, &work] (bool success) { flushed = success; work.reset(); });
+    testIoContext.run();
+    EXPECT_TRUE(flushed);
+
+    std::ifstream ifs(filename, std::ios_base::binary);
+    std::string output((std::istreambuf_iterator<char>(ifs)), std::istreambuf_iterator<char>());
+    EXPECT_TRUE(output == existing + input);
+}
+
+TEST(TTFTPWriteBehind, PreallocatedFileCorrect)
+{
+    checkPreallocatedFile("PreallocatedTestFile.bin", "existing", {});
+}
+
+//Test the same with the chunks written through a file I/O backend, where writes of several chunks may be in flight at once
+TEST(TTFTPWriteBehind, PreallocatedFileCorrectWithFileIo)
+{
+    checkPreallocatedFile("PreallocatedFileIoTestFile.bin", "existing", makeFileIo(TftpFileIoBackend::IO_URING));
+}
+
+//Test if an upload written with direct I/O is complete, including its unaligned tail, with and without a file I/O backend
+TEST(TTFTPWriteBehind, PreallocatedFileCorrectWithDirectIo)
+{
+    checkPreallocatedFile("PreallocatedDirectTestFile.bin", "", {}, true);
+    checkPreallocatedFile("PreallocatedDirectFileIoTestFile.bin", "", makeFileIo(TftpFileIoBackend::IO_URING), true);
+}
+
+//Test if a reader that maps the file while it is uploaded only sees written data, and can still touch its mapping after the upload ended short
+TEST(TTFTPWriteBehind, ConcurrentReaderOfShortUpload)
+{
+    std::string filename = "PreallocatedConcurrentReaderTestFile.bin";
+    std::remove(filename.c_str());
+
+    std::string input;
+    for(std::size_t i = 0; i < 3 * 64 * 1024; ++i)
+    {
+        input.push_back(rand() % 255 + 1);
+    }
+
+    std::error_code ec;
+    std::shared_ptr<TftpWriteBehind> writebehind = TftpWriteBehind::openPreallocated(filename, 1024 * 1024, 64 * 1024, ec);
+    ASSERT_TRUE(writebehind);
+    writebehind->append(input.data(), input.size());
+
+    boost::asio::io_context testIoContext;
+    auto work = boost::asio::make_work_guard(testIoContext);
+    bool flushed = false;
+    writebehind->flush(testIoContext.get_executor(), [&flushed, &work] (bool success) { flushed = success; work.reset(); });
+    testIoContext.run();
+    EXPECT_TRUE(flushed);
+
+    //The reader sees the received data, not the zero-filled rest of the preallocation
+    ASSERT_EQ(std::filesystem::file_size(filename), input.size());
+    int fd = ::open(filename.c_str(), O_RDONLY);
+    ASSERT_GE(fd, 0);
+    void *mapping = mmap(nullptr, input.size(), PROT_READ, MAP_SHARED, fd, 0);
+    ASSERT_NE(mapping, MAP_FAILED);
+
+    //Releasing the rest of the preallocation and closing the file does not cut away the mapped pages
+    writebehind.reset();
+
+    EXPECT_EQ(std::filesystem::file_size(filename), input.size());
+    EXPECT_TRUE(std::equal(input.begin(), input.end(), static_cast<const char*>(mapping)));
+
+    munmap(mapping, input.size());
+    ::close(fd);
+    std::remove(filename.c_str());
+}
+
+//Test if a file that does not end at an aligned offset is appended to through the page cache instead
+TEST(TTFTPWriteBehind, DirectIoOnlyAtAlignedOffset)
+{
+    std::string filename = "DirectUnalignedTestFile.bin";
+    {
+        std::ofstream ofs(filename, std::ios_base::binary);
+        ofs << "existing";
+    }
+    std::error_code ec;
+    std::shared_ptr<TftpWriteBehind> writebehind = TftpWriteBehind::openPreallocated(filename, 1024 * 1024, 64 * 1024, ec, {}, true);
+    ASSERT_TRUE(writebehind);
+    EXPECT_FALSE(writebehind->isDirect());
+    writebehind.reset();
+    std::remove(filename.c_str());
+}
+
+//Test if a file that does not fit on the disk is rejected before anything is written
+TEST(TTFTPWriteBehind, PreallocationFailsWhenTooLarge)
+{
+    std::string filename = "PreallocatedTooLargeTestFile.bin";
+    std::remove(filename.c_str());
+
+    std::error_code ec;
+    std::shared_ptr<TftpWriteBehind> writebehind = TftpWriteBehind::openPreallocated(filename, uint64_t{1} << 62, 64 * 1024, ec);
+    EXPECT_FALSE(writebehind);
+    EXPECT_TRUE(ec == std::errc::no_space_on_device || ec == std::errc::file_too_large);
+}